@@ -1,13 +1,52 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include "image_manager.h"
 
+#ifdef _WIN32
+#include <io.h>
+#define syncDescriptor(fd) _commit(fd)
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#define syncDescriptor(fd) fsync(fd)
+#endif
+
+#define INDEX_TEMP_FILE "image_index.tmp"
+
+// Funções privadas
+static int convertLegacyIndex();
+static void finishLegacyConversion();
+static int writeConvertedIndex(FILE* old_index, FILE* new_index, int* count);
+static int syncFile(const char* filename);
+static int replaceFile(const char* temp_name, const char* filename);
+
 /**
  * Inicializa os arquivos do banco de dados
- * Cria os arquivos se não existirem
+ * Cria os arquivos se não existirem. Sem dicionário de nomes o índice está
+ * no formato antigo e é convertido; o dicionário só passa a existir depois
+ * que o índice convertido está gravado no disco
  */
 void initializeDatabase() {
+    FILE* names_file = fopen(NAMES_FILE, "rb");
+    int has_dictionary = (names_file != NULL);
+    if (names_file) fclose(names_file);
+    
+    if (!has_dictionary && !convertLegacyIndex()) {
+        printf("Erro: Falha ao converter o image_index.dat (o original foi mantido)\n");
+        exit(1);
+    }
+    finishLegacyConversion();
+    
+    if (!loadNameDictionary(NAMES_FILE)) {
+        printf("Erro: Não foi possível abrir %s\n", NAMES_FILE);
+        exit(1);
+    }
+    
     FILE* index_file = fopen("image_index.dat", "ab");
     FILE* data_file = fopen("image_data.dat", "ab");
     if (index_file) fclose(index_file);
@@ -15,60 +54,176 @@ void initializeDatabase() {
 }
 
 /**
- * Adiciona uma imagem ao banco de dados
- * Processo: Ler PGM → Binarizar → Comprimir → Salvar dados → Atualizar índice
+ * Converte o image_index.dat antigo (nome em cada entrada) para entradas com
+ * chave (id do nome, limiar)
+ * Dicionário e índice novos são gravados em arquivos temporários; o rename
+ * do dicionário confirma a conversão e só então o índice é trocado (o
+ * original fica em image_index.dat.old). Queda antes disso refaz a
+ * conversão do início na próxima abertura
+ * Retorna 0 se falhou (o image_index.dat original não é alterado)
  */
-int addImageToDatabase(const char* filename, int threshold) {
-    // Ler e processar imagem
-    PGMImage* img = readPGM(filename);
-    if (!img) return 0;
+static int convertLegacyIndex() {
+    FILE* old_index = fopen("image_index.dat", "rb");
+    if (!old_index) return 1;
     
-    binarizeImage(img, threshold);
+    if (getFileSize(old_index) <= 0) {
+        fclose(old_index);
+        return 1;
+    }
     
-    // Comprimir imagem
-    int compressed_size;
-    unsigned char* compressed_data = compressRLE(img->pixels, img->width, img->height, &compressed_size);
-    if (!compressed_data) {
-        freePGM(img);
-        return 0;
+    remove(NAMES_TEMP_FILE);
+    remove(INDEX_TEMP_FILE);
+    
+    FILE* new_index = fopen(INDEX_TEMP_FILE, "wb");
+    int count = 0;
+    int ok = new_index && loadNameDictionary(NAMES_TEMP_FILE) &&
+             writeConvertedIndex(old_index, new_index, &count);
+    
+    fclose(old_index);
+    if (new_index) {
+        ok = ok && fflush(new_index) == 0 && syncDescriptor(fileno(new_index)) == 0;
+        ok = (fclose(new_index) == 0) && ok;
     }
+    freeNameDictionary();
     
-    // Salvar dados comprimidos
-    FILE* data_file = fopen("image_data.dat", "ab");
-    if (!data_file) {
-        free(compressed_data);
-        freePGM(img);
+    ok = ok && syncFile(NAMES_TEMP_FILE) && replaceFile(NAMES_TEMP_FILE, NAMES_FILE);
+    if (!ok) {
+        remove(NAMES_TEMP_FILE);
+        remove(INDEX_TEMP_FILE);
         return 0;
     }
     
+    printf("Índice convertido: %d entradas (original salvo em image_index.dat.old)\n", count);
+    return 1;
+}
+
+/**
+ * Troca o image_index.dat pelo índice convertido, se ele ainda está no
+ * arquivo temporário (também termina uma troca interrompida por queda)
+ */
+static void finishLegacyConversion() {
+    FILE* temp_file = fopen(INDEX_TEMP_FILE, "rb");
+    if (!temp_file) return;
+    fclose(temp_file);
+    
+    // Enquanto o temporário existe, o image_index.dat é o do formato antigo
+    FILE* old_index = fopen("image_index.dat", "rb");
+    if (old_index) {
+        fclose(old_index);
+        remove("image_index.dat.old");
+        if (rename("image_index.dat", "image_index.dat.old") != 0) {
+            printf("Erro: Não foi possível preservar o image_index.dat antigo\n");
+            exit(1);
+        }
+    }
+    
+    if (!replaceFile(INDEX_TEMP_FILE, "image_index.dat")) {
+        printf("Erro: Não foi possível trocar o image_index.dat pelo índice convertido\n");
+        exit(1);
+    }
+}
+
+/**
+ * Grava em new_index as entradas do índice antigo com a chave (id, limiar)
+ * Retorna 0 se algum nome não pôde entrar no dicionário ou a leitura/escrita
+ * falhou (nenhuma entrada é descartada)
+ */
+static int writeConvertedIndex(FILE* old_index, FILE* new_index, int* count) {
+    LegacyImageIndex old_entry;
+    ImageIndex entry;
+    
+    fseek(old_index, 0, SEEK_SET);
+    while (fread(&old_entry, sizeof(LegacyImageIndex), 1, old_index)) {
+        old_entry.name[MAX_NAME_LEN - 1] = '\0';
+        unsigned int name_id = internName(old_entry.name);
+        if (name_id == NAME_NONE) {
+            printf("Erro: Nome inválido no índice antigo: \"%s\"\n", old_entry.name);
+            return 0;
+        }
+        
+        entry.key = makeIndexKey(name_id, old_entry.threshold);
+        entry.offset = old_entry.offset;
+        entry.compressed_size = old_entry.compressed_size;
+        entry.width = old_entry.width;
+        entry.height = old_entry.height;
+        entry.max_gray = old_entry.max_gray;
+        entry.removed = old_entry.removed;
+        if (fwrite(&entry, sizeof(ImageIndex), 1, new_index) != 1) return 0;
+        (*count)++;
+    }
+    
+    return !ferror(old_index);
+}
+
+/**
+ * Força o conteúdo do arquivo para o disco
+ */
+static int syncFile(const char* filename) {
+    FILE* file = fopen(filename, "r+b");
+    if (!file) return 0;
+    
+    int ok = syncDescriptor(fileno(file)) == 0;
+    return (fclose(file) == 0) && ok;
+}
+
+/**
+ * Substitui filename por temp_name (rename atômico) e grava a troca no
+ * diretório
+ */
+static int replaceFile(const char* temp_name, const char* filename) {
+    if (rename(temp_name, filename) != 0) {
+        // Windows não substitui um arquivo existente no rename
+        remove(filename);
+        if (rename(temp_name, filename) != 0) return 0;
+    }
+    
+#ifndef _WIN32
+    int dir = open(".", O_RDONLY);
+    if (dir >= 0) {
+        fsync(dir);
+        close(dir);
+    }
+#endif
+    return 1;
+}
+
+/**
+ * Adiciona uma imagem ao banco de dados
+ * Processo: Ler PGM → Binarizar → Comprimir → Salvar dados, linha a linha
+ * (a imagem nunca fica inteira na memória) → Atualizar índice
+ */
+int addImageToDatabase(const char* filename, int threshold) {
+    FILE* data_file = fopen("image_data.dat", "ab");
+    if (!data_file) return 0;
+    
+    // Sequências RLE gravadas direto no arquivo de dados conforme as linhas são lidas
     long offset = ftell(data_file);
-    fwrite(compressed_data, 1, compressed_size, data_file);
+    int width, height, compressed_size;
+    int compressed = compressPGMToFile(filename, threshold, data_file, &width, &height, &compressed_size);
     fclose(data_file);
+    if (!compressed) return 0;
     
-    // Atualizar arquivo de índices
-    FILE* index_file = fopen("image_index.dat", "ab");
-    if (!index_file) {
-        free(compressed_data);
-        freePGM(img);
-        return 0;
-    }
+    // Atualizar arquivo de índices (nome novo entra no dicionário)
+    char name[MAX_NAME_LEN];
+    strncpy(name, filename, MAX_NAME_LEN - 1);
+    name[MAX_NAME_LEN - 1] = '\0';
+    unsigned int name_id = internName(name);
+    
+    FILE* index_file = (name_id != NAME_NONE) ? fopen("image_index.dat", "ab") : NULL;
+    if (!index_file) return 0;
     
     ImageIndex entry;
-    strncpy(entry.name, filename, MAX_NAME_LEN - 1);
-    entry.name[MAX_NAME_LEN - 1] = '\0';
-    entry.threshold = threshold;
+    entry.key = makeIndexKey(name_id, threshold);
     entry.offset = offset;
     entry.compressed_size = compressed_size;
-    entry.width = img->width;
-    entry.height = img->height;
-    entry.max_gray = img->max_gray;
+    entry.width = width;
+    entry.height = height;
+    entry.max_gray = 1;
     entry.removed = 0;
     
     fwrite(&entry, sizeof(ImageIndex), 1, index_file);
     fclose(index_file);
     
-    free(compressed_data);
-    freePGM(img);
     return 1;
 }
 
@@ -85,8 +240,10 @@ int listImagesInDatabase() {
     printf("\n=== IMAGENS NO BANCO DE DADOS ===\n");
     while (fread(&entry, sizeof(ImageIndex), 1, index_file)) {
         if (!entry.removed) {
+            const char* name = getNameById(keyNameId(entry.key));
             printf("%d. Nome: %s | Limiar: %d | Dimensões: %dx%d | Tamanho: %d bytes\n",
-                   ++count, entry.name, entry.threshold, entry.width, entry.height, entry.compressed_size);
+                   ++count, name ? name : "?", keyThreshold(entry.key), entry.width, entry.height,
+                   entry.compressed_size);
         }
     }
     
@@ -98,6 +255,11 @@ int listImagesInDatabase() {
  * Remove uma imagem logicamente (marca como removida no índice)
  */
 int removeImageFromDatabase(const char* name, int threshold) {
+    // Nome nunca cadastrado não tem entradas; senão a busca compara inteiros
+    unsigned int name_id = findNameId(name);
+    if (name_id == NAME_NONE) return 0;
+    unsigned long long key = makeIndexKey(name_id, threshold);
+    
     FILE* index_file = fopen("image_index.dat", "r+b");
     if (!index_file) return 0;
     
@@ -106,7 +268,7 @@ int removeImageFromDatabase(const char* name, int threshold) {
     int found = 0;
     
     while (fread(&entry, sizeof(ImageIndex), 1, index_file)) {
-        if (strcmp(entry.name, name) == 0 && entry.threshold == threshold && !entry.removed) {
+        if (entry.key == key && !entry.removed) {
             // Marcar como removida
             entry.removed = 1;
             fseek(index_file, position, SEEK_SET);
@@ -178,9 +340,13 @@ int compactDatabase() {
 }
 
 /**
- * Recupera uma imagem do banco de dados e salva em formato PGM
+ * Recupera uma imagem do banco de dados e salva no formato pedido (P2, P5 ou P4)
  */
-int retrieveImageFromDatabase(const char* name, int threshold, const char* output_filename) {
+int retrieveImageFromDatabase(const char* name, int threshold, const char* output_filename, int format) {
+    unsigned int name_id = findNameId(name);
+    if (name_id == NAME_NONE) return 0;
+    unsigned long long key = makeIndexKey(name_id, threshold);
+    
     FILE* index_file = fopen("image_index.dat", "rb");
     if (!index_file) return 0;
     
@@ -188,8 +354,8 @@ int retrieveImageFromDatabase(const char* name, int threshold, const char* outpu
     int found = 0;
     
     // Buscar entrada no índice
-    while (fread(&entry, sizeof(ImageIndex), 1, index_file) && !found) {
-        if (strcmp(entry.name, name) == 0 && entry.threshold == threshold && !entry.removed) {
+    while (!found && fread(&entry, sizeof(ImageIndex), 1, index_file)) {
+        if (entry.key == key && !entry.removed) {
             found = 1;
         }
     }
@@ -211,26 +377,10 @@ int retrieveImageFromDatabase(const char* name, int threshold, const char* outpu
     fread(compressed_data, 1, entry.compressed_size, data_file);
     fclose(data_file);
     
-    // Descomprimir e reconstruir imagem
-    int** pixels = decompressRLE(compressed_data, entry.compressed_size, entry.width, entry.height);
+    // Gravar direto das sequências RLE, sem descomprimir para a matriz
+    int success = writeRLEAsPGM(output_filename, compressed_data, entry.compressed_size,
+                                entry.width, entry.height, format);
     free(compressed_data);
     
-    if (!pixels) return 0;
-    
-    PGMImage* img = (PGMImage*)malloc(sizeof(PGMImage));
-    if (!img) {
-        for (int i = 0; i < entry.height; i++) free(pixels[i]);
-        free(pixels);
-        return 0;
-    }
-    
-    img->width = entry.width;
-    img->height = entry.height;
-    img->max_gray = entry.max_gray;
-    img->pixels = pixels;
-    
-    int success = writePGM(output_filename, img);
-    freePGM(img);
-    
     return success;
-}
\ No newline at end of file
+}
@@ -0,0 +1,231 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "image_manager.h"
+
+#ifdef _WIN32
+#include <io.h>
+#define truncateFile(fd, size) _chsize(fd, size)
+#else
+#include <unistd.h>
+#define truncateFile(fd, size) ftruncate(fd, size)
+#endif
+
+// Dicionário em memória: id -> nome (vetor) e nome -> id (tabela de
+// espalhamento com endereçamento aberto, guarda id + 1; 0 = posição vazia)
+static char** dictionary_names = NULL;
+static unsigned int dictionary_count = 0;
+static unsigned int dictionary_capacity = 0;
+static unsigned int* dictionary_table = NULL;
+static unsigned int dictionary_table_size = 0;
+static long dictionary_end = 0;     // fim do último registro completo no arquivo
+static const char* dictionary_file = NAMES_FILE;
+
+// Funções privadas
+static unsigned int hashName(const char* name);
+static unsigned int lookupName(const char* name, unsigned int* slot);
+static int addName(const char* name);
+static int growNameTable();
+
+/**
+ * Carrega o dicionário de nomes de filename (cria o arquivo se não existir);
+ * os nomes cadastrados depois vão para o mesmo arquivo
+ * Arquivo: um registro por nome, na ordem dos ids: tamanho (unsigned char)
+ * seguido dos bytes do nome. Registro incompleto no fim (gravação
+ * interrompida) é cortado do arquivo, para os próximos nomes entrarem logo
+ * após o último registro completo e os ids continuarem batendo com o índice
+ */
+int loadNameDictionary(const char* filename) {
+    freeNameDictionary();
+    if (!growNameTable()) return 0;
+    dictionary_file = filename;
+    
+    FILE* file = fopen(dictionary_file, "r+b");
+    if (!file) {
+        file = fopen(dictionary_file, "wb");
+        if (!file) return 0;
+        fclose(file);
+        return 1;
+    }
+    
+    char name[MAX_NAME_LEN];
+    unsigned char length;
+    long end = 0;
+    while (fread(&length, 1, 1, file) == 1) {
+        if (length == 0 || length >= MAX_NAME_LEN || fread(name, 1, length, file) != length) break;
+        name[length] = '\0';
+        if (!addName(name)) {
+            fclose(file);
+            return 0;
+        }
+        end = ftell(file);
+    }
+    
+    fseek(file, 0, SEEK_END);
+    if (ftell(file) != end) {
+        fflush(file);
+        if (truncateFile(fileno(file), end) != 0) {
+            fprintf(stderr, "Erro: Não foi possível ajustar %s\n", dictionary_file);
+            fclose(file);
+            return 0;
+        }
+    }
+    
+    dictionary_end = end;
+    return fclose(file) == 0;
+}
+
+/**
+ * Libera o dicionário em memória
+ */
+void freeNameDictionary() {
+    for (unsigned int i = 0; i < dictionary_count; i++) {
+        free(dictionary_names[i]);
+    }
+    free(dictionary_names);
+    free(dictionary_table);
+    dictionary_names = NULL;
+    dictionary_table = NULL;
+    dictionary_count = dictionary_capacity = dictionary_table_size = 0;
+    dictionary_end = 0;
+}
+
+/**
+ * Id do nome ou NAME_NONE se ele nunca foi cadastrado
+ */
+unsigned int findNameId(const char* name) {
+    if (!dictionary_table || name[0] == '\0' || strlen(name) >= MAX_NAME_LEN) return NAME_NONE;
+    return lookupName(name, NULL);
+}
+
+/**
+ * Id do nome, cadastrando-o no fim do arquivo se ainda não existe
+ * Retorna NAME_NONE se o nome é vazio, longo demais ou não pôde ser gravado
+ * (uma gravação incompleta é cortada do arquivo)
+ */
+unsigned int internName(const char* name) {
+    unsigned int id = findNameId(name);
+    if (id != NAME_NONE || !dictionary_table || name[0] == '\0' || strlen(name) >= MAX_NAME_LEN) return id;
+    
+    FILE* file = fopen(dictionary_file, "r+b");
+    if (!file) return NAME_NONE;
+    
+    unsigned char length = (unsigned char)strlen(name);
+    int ok = fseek(file, dictionary_end, SEEK_SET) == 0 &&
+             fwrite(&length, 1, 1, file) == 1 && fwrite(name, 1, length, file) == length;
+    ok = (fflush(file) == 0) && ok;
+    if (!ok) {
+        truncateFile(fileno(file), dictionary_end);
+        fclose(file);
+        fprintf(stderr, "Erro: Não foi possível gravar o nome %s em %s\n", name, dictionary_file);
+        return NAME_NONE;
+    }
+    if (fclose(file) != 0 || !addName(name)) return NAME_NONE;
+    
+    dictionary_end += 1 + length;
+    return dictionary_count - 1;
+}
+
+/**
+ * Nome do id (NULL se o id não existe)
+ */
+const char* getNameById(unsigned int id) {
+    return (id < dictionary_count) ? dictionary_names[id] : NULL;
+}
+
+/**
+ * Chave de 64 bits da entrada do índice: id do nome em cima e limiar com o
+ * bit de sinal invertido embaixo (comparar chaves = comparar inteiros)
+ */
+unsigned long long makeIndexKey(unsigned int name_id, int threshold) {
+    return ((unsigned long long)name_id << 32) | ((unsigned int)threshold ^ 0x80000000u);
+}
+
+/**
+ * Id do nome guardado na chave
+ */
+unsigned int keyNameId(unsigned long long key) {
+    return (unsigned int)(key >> 32);
+}
+
+/**
+ * Limiar guardado na chave
+ */
+int keyThreshold(unsigned long long key) {
+    return (int)((unsigned int)key ^ 0x80000000u);
+}
+
+/**
+ * Espalhamento FNV-1a de 32 bits do nome
+ */
+static unsigned int hashName(const char* name) {
+    unsigned int hash = 2166136261u;
+    for (const unsigned char* p = (const unsigned char*)name; *p; p++) {
+        hash = (hash ^ *p) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Procura o nome na tabela; slot recebe a posição onde ele está ou entraria
+ */
+static unsigned int lookupName(const char* name, unsigned int* slot) {
+    unsigned int mask = dictionary_table_size - 1;
+    unsigned int i = hashName(name) & mask;
+    
+    while (dictionary_table[i] != 0 && strcmp(dictionary_names[dictionary_table[i] - 1], name) != 0) {
+        i = (i + 1) & mask;
+    }
+    
+    if (slot) *slot = i;
+    return dictionary_table[i] ? dictionary_table[i] - 1 : NAME_NONE;
+}
+
+/**
+ * Acrescenta o nome (ainda ausente) na memória com o próximo id
+ */
+static int addName(const char* name) {
+    if (dictionary_count == dictionary_capacity) {
+        unsigned int capacity = dictionary_capacity ? dictionary_capacity * 2 : 64;
+        char** temp = (char**)realloc(dictionary_names, capacity * sizeof(char*));
+        if (!temp) return 0;
+        dictionary_names = temp;
+        dictionary_capacity = capacity;
+    }
+    // Tabela no máximo meio cheia
+    if ((dictionary_count + 1) * 2 > dictionary_table_size && !growNameTable()) return 0;
+    
+    char* copy = (char*)malloc(strlen(name) + 1);
+    if (!copy) return 0;
+    strcpy(copy, name);
+    
+    unsigned int slot;
+    lookupName(name, &slot);
+    dictionary_names[dictionary_count] = copy;
+    dictionary_table[slot] = ++dictionary_count;
+    return 1;
+}
+
+/**
+ * Dobra a tabela de espalhamento e reinsere os ids
+ */
+static int growNameTable() {
+    unsigned int size = dictionary_table_size ? dictionary_table_size * 2 : 256;
+    unsigned int* table = (unsigned int*)calloc(size, sizeof(unsigned int));
+    if (!table) return 0;
+    
+    for (unsigned int id = 0; id < dictionary_count; id++) {
+        unsigned int i = hashName(dictionary_names[id]) & (size - 1);
+        while (table[i] != 0) i = (i + 1) & (size - 1);
+        table[i] = id + 1;
+    }
+    
+    free(dictionary_table);
+    dictionary_table = table;
+    dictionary_table_size = size;
+    return 1;
+}
@@ -7,8 +7,24 @@
 
 #define MAX_NAME_LEN 50
 #define MAX_THRESHOLDS 10
+#define NAMES_FILE "image_names.dat"
+#define NAMES_TEMP_FILE "image_names.tmp"
+#define NAME_NONE 0xFFFFFFFFu
 
 // Estrutura para entrada no arquivo de índices
+// O nome fica no dicionário (image_names.dat); a entrada guarda só a chave
+// (id do nome, limiar) em 64 bits, comparada como um inteiro
+typedef struct {
+    unsigned long long key;
+    long offset;
+    int compressed_size;
+    int width;
+    int height;
+    int max_gray;
+    int removed;
+} ImageIndex;
+
+// Entrada do formato antigo do índice (nome de tamanho fixo), convertida ao iniciar
 typedef struct {
     char name[MAX_NAME_LEN];
     int threshold;
@@ -18,32 +34,83 @@ typedef struct {
     int height;
     int max_gray;
     int removed;
-} ImageIndex;
+} LegacyImageIndex;
+
+// Alinhamento do buffer e das linhas da imagem (bytes)
+#define PGM_ALIGN 32
 
 // Estrutura para imagem PGM
+// Amostras num único buffer alinhado: a linha i começa em data + i * stride;
+// 1 byte por amostra se max_gray <= 255, senão 2 (unsigned short)
 typedef struct {
     int width;
     int height;
     int max_gray;
-    int **pixels;
+    int binary;         // 1: arquivo P5 (amostras binárias), 0: P2 (ASCII)
+    int sample_bytes;   // 1 ou 2
+    int stride;         // bytes por linha (múltiplo de PGM_ALIGN)
+    unsigned char* data;
 } PGMImage;
 
+// Linha i da imagem com amostras de 8 ou de 16 bits
+#define PGM_ROW8(img, i) ((img)->data + (size_t)(i) * (img)->stride)
+#define PGM_ROW16(img, i) ((unsigned short*)((img)->data + (size_t)(i) * (img)->stride))
+
+// Imagem binária (resultado da limiarização) com 1 bit por pixel
+// Pixel j da linha i: bit j % 64 da palavra j / 64 da linha; as linhas são
+// completadas até a palavra e os bits de sobra ficam em 0
+typedef struct {
+    int width;
+    int height;
+    int words_per_row;
+    unsigned long long* bits;
+} BinaryImage;
+
+// Linha i (palavras de 64 bits) da imagem binária
+#define BINARY_ROW(img, i) ((img)->bits + (size_t)(i) * (img)->words_per_row)
+
 // Estrutura para múltiplas versões de uma imagem (reconstrução)
 typedef struct {
     int threshold;
-    PGMImage *image;
+    BinaryImage *image;
 } ImageVersion;
 
+// Formatos de saída
+#define PGM_FORMAT_P2 2     // ASCII
+#define PGM_FORMAT_P4 4     // PBM, 1 bit por pixel (só imagens binárias)
+#define PGM_FORMAT_P5 5     // binário, 8 ou 16 bits por amostra
+
+// Formatos do registro RLE no arquivo de dados
+// Antigo (PDF): [primeiro_pixel (0 ou 1), contagens de até 255...]; uma
+// contagem de 255 seguida de outra é ambígua (mesmo valor ou alternância)
+// Versão 2: [RLE_FORMAT_VARINT, primeiro_pixel, sequências em LEB128...],
+// cada sequência inteira (sem limite) e o valor sempre alterna
+#define RLE_FORMAT_VARINT 2
+
 // Processamento de imagens
+PGMImage* createPGM(int width, int height, int max_gray);
 PGMImage* readPGM(const char* filename);
 int writePGM(const char* filename, PGMImage* img);
-void binarizeImage(PGMImage* img, int threshold);
+int writePGMFormat(const char* filename, PGMImage* img, int format);
+int writeRLEAsPGM(const char* filename, const unsigned char* data, int size, int width, int height, int format);
+BinaryImage* binarizeImage(const PGMImage* img, int threshold);
 void negativeImage(PGMImage* img);
 void freePGM(PGMImage* img);
+BinaryImage* createBinaryImage(int width, int height);
+long countWhitePixels(const BinaryImage* img);
+void freeBinaryImage(BinaryImage* img);
 
 // Compressão e descompressão
-unsigned char* compressRLE(int** pixels, int width, int height, int* compressed_size);
-int** decompressRLE(unsigned char* compressed_data, int compressed_size, int width, int height);
+unsigned char* compressRLE(const BinaryImage* img, int* compressed_size);
+BinaryImage* decompressRLE(unsigned char* compressed_data, int compressed_size, int width, int height);
+int compressPGMToFile(const char* filename, int threshold, FILE* output, int* width, int* height, int* compressed_size);
+
+// Kernels de pixels (simd.c): variante vetorial escolhida pela CPU
+void binarizeRow8(const unsigned char* in, int width, int threshold, unsigned long long* out);
+void binarizeRow16(const unsigned short* in, int width, int threshold, unsigned long long* out);
+void negateRow8(unsigned char* row, int width, unsigned char max);
+void negateRow16(unsigned short* row, int width, unsigned short max);
+const char* pixelKernelName();
 
 // Gerenciamento do banco de dados
 void initializeDatabase();
@@ -51,7 +118,17 @@ int addImageToDatabase(const char* filename, int threshold);
 int listImagesInDatabase();
 int removeImageFromDatabase(const char* name, int threshold);
 int compactDatabase();
-int retrieveImageFromDatabase(const char* name, int threshold, const char* output_filename);
+int retrieveImageFromDatabase(const char* name, int threshold, const char* output_filename, int format);
+
+// Dicionário de nomes (nome -> id denso, na ordem de cadastro)
+int loadNameDictionary(const char* filename);
+void freeNameDictionary();
+unsigned int findNameId(const char* name);
+unsigned int internName(const char* name);
+const char* getNameById(unsigned int id);
+unsigned long long makeIndexKey(unsigned int name_id, int threshold);
+unsigned int keyNameId(unsigned long long key);
+int keyThreshold(unsigned long long key);
 
 // Reconstrução (Bônus)
 int reconstructOriginalImage(const char* name, const char* output_filename);
@@ -60,5 +137,7 @@ int reconstructOriginalImage(const char* name, const char* output_filename);
 long getFileSize(FILE* file);
 void printImageInfo(PGMImage* img);
 int isRemoved(ImageIndex* entry);
+int countSetBits(unsigned long long word);
+int lowestSetBit(unsigned long long word);
 
-#endif
\ No newline at end of file
+#endif
@@ -2,120 +2,599 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <limits.h>
+#include <stdint.h>
 #include "image_manager.h"
 
+// Tamanho dos blocos lidos do arquivo PGM
+#define PGM_READ_BLOCK 65536
+
+// Leitor em blocos do PGM; guarda a linha atual e onde ela começa no
+// arquivo para informar linha e coluna dos erros
+typedef struct {
+    FILE* file;
+    unsigned char buffer[PGM_READ_BLOCK];
+    int position;
+    int length;
+    long block_offset;  // posição no arquivo do início do bloco
+    long line_start;    // posição no arquivo do início da linha atual
+    int line;
+} PGMReader;
+
+// Tamanho do buffer do escritor de PGM
+#define PGM_WRITE_BLOCK 65536
+
+// Escritor em blocos: linhas formatadas no buffer, gravado de uma vez
+typedef struct {
+    FILE* file;
+    unsigned char buffer[PGM_WRITE_BLOCK];
+    int length;
+    int failed;
+} PGMWriter;
+
+// Codificador RLE incremental (formato RLE_FORMAT_VARINT): a sequência atual
+// continua de uma linha para a outra; cada linha acrescenta no máximo
+// width + RLE_VARINT_MAX bytes em data
+typedef struct {
+    unsigned char* data;
+    long length;
+    int value;
+    unsigned long long count;
+} RLEEncoder;
+
+// Bytes de uma contagem de 64 bits em LEB128
+#define RLE_VARINT_MAX 10
+
+// Leitor das sequências de um registro RLE, no formato antigo ou no LEB128;
+// value é o valor da próxima sequência
+typedef struct {
+    const unsigned char* data;
+    int size;
+    int index;
+    int varint;
+    int value;
+} RLEReader;
+
+// Dois dígitos decimais por entrada ("00" a "99")
+static const char digit_pairs[201] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+// Sequências de pixels binários já formatadas em P2 ("0 0 0 ..." e "1 1 1 ...")
+#define RUN_PATTERN_PAIRS 256
+static unsigned char run_patterns[2][2 * RUN_PATTERN_PAIRS];
+
+// Funções privadas
+static int fillReader(PGMReader* reader);
+static int readNumber(PGMReader* reader, int* value);
+static int readRaw(PGMReader* reader, void* dest, size_t count);
+static void readerError(const PGMReader* reader, const char* filename, const char* message);
+static int readAsciiRow(PGMReader* reader, PGMImage* img, int row);
+static int readBinaryRow(PGMReader* reader, PGMImage* img, int row);
+static int readPGMHeader(PGMReader* reader, const char* filename, PGMImage* header);
+static int readRow(PGMReader* reader, const char* filename, PGMImage* img, int row, int file_row);
+static void startRLE(RLEEncoder* encoder, unsigned char* data, int first_pixel);
+static void encodeRowRLE(RLEEncoder* encoder, const unsigned long long* row, int width);
+static int putVarint(unsigned char* out, unsigned long long value);
+static void startRuns(RLEReader* reader, const unsigned char* data, int size);
+static int nextRun(RLEReader* reader, unsigned long long* length, int* value);
+static int openWriter(PGMWriter* writer, const char* filename);
+static void flushWriter(PGMWriter* writer);
+static unsigned char* reserveWriter(PGMWriter* writer, int count);
+static int closeWriter(PGMWriter* writer, const char* filename);
+static void writeHeader(PGMWriter* writer, int format, int width, int height, int max_gray);
+static void writeSample(PGMWriter* writer, int value);
+static void packBitRow(unsigned char* out, const unsigned char* row, int width);
+static void setBitRange(unsigned char* bits, int first, int count);
+static void setBitRange64(unsigned long long* row, int first, int count);
+
+/**
+ * Cria uma imagem com as amostras zeradas num único bloco de memória:
+ * estrutura e buffer de pixels juntos, o buffer alinhado em PGM_ALIGN
+ * Retorna NULL se as dimensões são inválidas ou falta memória
+ */
+PGMImage* createPGM(int width, int height, int max_gray) {
+    if (width <= 0 || height <= 0 || max_gray <= 0 || max_gray > 65535) return NULL;
+    
+    int sample_bytes = max_gray > 255 ? 2 : 1;
+    size_t stride = ((size_t)width * sample_bytes + PGM_ALIGN - 1) & ~(size_t)(PGM_ALIGN - 1);
+    if (stride > INT_MAX || (size_t)height > ((size_t)-1 - sizeof(PGMImage) - PGM_ALIGN) / stride) return NULL;
+    
+    PGMImage* img = (PGMImage*)calloc(1, sizeof(PGMImage) + PGM_ALIGN + stride * height);
+    if (!img) return NULL;
+    
+    img->width = width;
+    img->height = height;
+    img->max_gray = max_gray;
+    img->binary = 0;
+    img->sample_bytes = sample_bytes;
+    img->stride = (int)stride;
+    img->data = (unsigned char*)(((uintptr_t)(img + 1) + PGM_ALIGN - 1) & ~(uintptr_t)(PGM_ALIGN - 1));
+    return img;
+}
+
 /**
- * Lê um arquivo PGM (formato P2 - ASCII)
+ * Lê um arquivo PGM: P2 (ASCII) ou P5 (binário, 8 ou 16 bits por amostra)
+ * O arquivo é lido em blocos; erros de formato informam linha e coluna
  * Retorna uma estrutura PGMImage ou NULL em caso de erro
  */
 PGMImage* readPGM(const char* filename) {
-    FILE* file = fopen(filename, "r");
-    if (!file) {
-        fprintf(stderr, "Erro: Não foi possível abrir o arquivo %s\n", filename);
+    PGMReader reader;
+    PGMImage header;
+    if (!readPGMHeader(&reader, filename, &header)) return NULL;
+    
+    PGMImage* img = createPGM(header.width, header.height, header.max_gray);
+    if (!img) {
+        fprintf(stderr, "Erro: Falha na alocação de memória para pixels.\n");
+        fclose(reader.file);
         return NULL;
     }
+    img->binary = header.binary;
     
-    char magic[3];
-    if (fscanf(file, "%2s", magic) != 1 || strcmp(magic, "P2") != 0) {
-        fprintf(stderr, "Erro: Formato PGM inválido. Esperado P2.\n");
-        fclose(file);
-        return NULL;
+    for (int i = 0; i < img->height; i++) {
+        if (!readRow(&reader, filename, img, i, i)) {
+            freePGM(img);
+            fclose(reader.file);
+            return NULL;
+        }
     }
     
-    // Pular comentários
-    int c;
-    while ((c = fgetc(file)) == ' ' || c == '\t' || c == '\n');
-    if (c == '#') {
-        while ((c = fgetc(file)) != '\n' && c != EOF);
-    } else {
-        ungetc(c, file);
+    fclose(reader.file);
+    return img;
+}
+
+/**
+ * Abre o arquivo e lê o cabeçalho PGM até o início das amostras; header
+ * recebe as dimensões, max_gray e o formato (sem buffer de pixels)
+ * Retorna 0 em caso de erro (o arquivo já fica fechado)
+ */
+static int readPGMHeader(PGMReader* reader, const char* filename, PGMImage* header) {
+    reader->file = fopen(filename, "rb");
+    if (!reader->file) {
+        fprintf(stderr, "Erro: Não foi possível abrir o arquivo %s\n", filename);
+        return 0;
     }
+    // Os blocos já são grandes: sem o buffer do stdio não há cópia extra
+    setvbuf(reader->file, NULL, _IONBF, 0);
+    reader->position = reader->length = 0;
+    reader->block_offset = reader->line_start = 0;
+    reader->line = 1;
     
-    PGMImage* img = (PGMImage*)malloc(sizeof(PGMImage));
-    if (!img) {
-        fprintf(stderr, "Erro: Falha na alocação de memória.\n");
-        fclose(file);
-        return NULL;
+    int magic = (fillReader(reader) && reader->length >= 2 && reader->buffer[0] == 'P') ? reader->buffer[1] : 0;
+    if (magic != '2' && magic != '5') {
+        fprintf(stderr, "Erro: Formato PGM inválido. Esperado P2 ou P5.\n");
+        fclose(reader->file);
+        return 0;
     }
+    reader->position = 2;
     
-    if (fscanf(file, "%d %d %d", &img->width, &img->height, &img->max_gray) != 3) {
+    int width, height, max_gray;
+    if (!readNumber(reader, &width) || !readNumber(reader, &height) || !readNumber(reader, &max_gray)) {
+        readerError(reader, filename, "cabeçalho PGM inválido");
+        fclose(reader->file);
+        return 0;
+    }
+    if (width <= 0 || height <= 0 || max_gray <= 0 || max_gray > 65535) {
         fprintf(stderr, "Erro: Cabeçalho PGM inválido.\n");
-        free(img);
-        fclose(file);
-        return NULL;
+        fclose(reader->file);
+        return 0;
     }
     
-    // Alocar memória para os pixels
-    img->pixels = (int**)malloc(img->height * sizeof(int*));
-    if (!img->pixels) {
-        fprintf(stderr, "Erro: Falha na alocação de memória para pixels.\n");
-        free(img);
-        fclose(file);
-        return NULL;
+    // P5: um único espaço separa o cabeçalho das amostras
+    unsigned char separator;
+    if (magic == '5' && (!readRaw(reader, &separator, 1) || !isspace(separator))) {
+        readerError(reader, filename, "esperado espaço antes das amostras");
+        fclose(reader->file);
+        return 0;
     }
     
-    for (int i = 0; i < img->height; i++) {
-        img->pixels[i] = (int*)malloc(img->width * sizeof(int));
-        if (!img->pixels[i]) {
-            fprintf(stderr, "Erro: Falha na alocação de memória para linha %d.\n", i);
-            for (int j = 0; j < i; j++) free(img->pixels[j]);
-            free(img->pixels);
-            free(img);
-            fclose(file);
-            return NULL;
+    memset(header, 0, sizeof(PGMImage));
+    header->width = width;
+    header->height = height;
+    header->max_gray = max_gray;
+    header->binary = (magic == '5');
+    header->sample_bytes = max_gray > 255 ? 2 : 1;
+    return 1;
+}
+
+/**
+ * Lê a linha file_row do arquivo para a linha row da imagem, informando o
+ * erro se ela falta ou é inválida
+ */
+static int readRow(PGMReader* reader, const char* filename, PGMImage* img, int row, int file_row) {
+    if (img->binary) {
+        if (readBinaryRow(reader, img, row)) return 1;
+        fprintf(stderr, "Erro: Leitura de pixels falhou na linha %d.\n", file_row);
+    } else {
+        if (readAsciiRow(reader, img, row)) return 1;
+        readerError(reader, filename, "amostra inválida, ausente ou maior que max_gray");
+    }
+    return 0;
+}
+
+/**
+ * Lê o próximo bloco do arquivo; retorna 0 no fim do arquivo
+ */
+static int fillReader(PGMReader* reader) {
+    reader->block_offset += reader->length;
+    reader->position = 0;
+    reader->length = (int)fread(reader->buffer, 1, PGM_READ_BLOCK, reader->file);
+    return reader->length > 0;
+}
+
+/**
+ * Lê um número decimal sem sinal, pulando antes espaços e comentários (#)
+ * Retorna 0 se não há número ali ou ele tem dígitos demais; a posição do
+ * leitor fica no caractere problemático
+ */
+static int readNumber(PGMReader* reader, int* value) {
+    unsigned char c = 0;
+    
+    // Separadores: a linha só é contada nas quebras
+    for (;;) {
+        if (reader->position == reader->length && !fillReader(reader)) return 0;
+        c = reader->buffer[reader->position];
+        if (c == '\n') {
+            reader->line++;
+            reader->line_start = reader->block_offset + reader->position + 1;
+        } else if (c == '#') {
+            while (c != '\n') {
+                if (++reader->position == reader->length && !fillReader(reader)) return 0;
+                c = reader->buffer[reader->position];
+            }
+            continue;
+        } else if (c != ' ' && c != '\t' && c != '\r' && c != '\v' && c != '\f') {
+            break;
         }
-        
+        reader->position++;
+    }
+    
+    if ((unsigned char)(c - '0') > 9) return 0;
+    
+    // Dígitos: laço apertado sobre o bloco, sem chamadas por caractere
+    unsigned int number = 0;
+    int digits = 0;
+    for (;;) {
+        const unsigned char* p = reader->buffer + reader->position;
+        const unsigned char* end = reader->buffer + reader->length;
+        unsigned int digit;
+        while (p < end && (digit = (unsigned int)(*p - '0')) <= 9) {
+            number = number * 10 + digit;
+            p++;
+            digits++;
+        }
+        reader->position = (int)(p - reader->buffer);
+        if (p < end || !fillReader(reader)) break;
+    }
+    
+    if (digits > 9) return 0;
+    *value = (int)number;
+    return 1;
+}
+
+/**
+ * Copia count bytes brutos: primeiro o que sobrou no bloco, o resto direto
+ * do arquivo para o destino
+ */
+static int readRaw(PGMReader* reader, void* dest, size_t count) {
+    size_t buffered = (size_t)(reader->length - reader->position);
+    if (buffered > count) buffered = count;
+    
+    memcpy(dest, reader->buffer + reader->position, buffered);
+    reader->position += (int)buffered;
+    if (buffered == count) return 1;
+    
+    size_t rest = count - buffered;
+    size_t got = fread((unsigned char*)dest + buffered, 1, rest, reader->file);
+    reader->block_offset += (long)got;
+    return got == rest;
+}
+
+/**
+ * Informa o erro de formato com a linha e a coluna da posição atual
+ */
+static void readerError(const PGMReader* reader, const char* filename, const char* message) {
+    long column = reader->block_offset + reader->position - reader->line_start + 1;
+    fprintf(stderr, "Erro: %s: %s (linha %d, coluna %ld).\n", filename, message, reader->line, column);
+}
+
+/**
+ * Lê uma linha P2 de amostras para o buffer da imagem
+ */
+static int readAsciiRow(PGMReader* reader, PGMImage* img, int row) {
+    int value;
+    if (img->sample_bytes == 1) {
+        unsigned char* out = PGM_ROW8(img, row);
         for (int j = 0; j < img->width; j++) {
-            if (fscanf(file, "%d", &img->pixels[i][j]) != 1) {
-                fprintf(stderr, "Erro: Leitura de pixel falhou na posição (%d, %d).\n", i, j);
-                for (int k = 0; k <= i; k++) free(img->pixels[k]);
-                free(img->pixels);
-                free(img);
-                fclose(file);
-                return NULL;
-            }
+            if (!readNumber(reader, &value) || value > img->max_gray) return 0;
+            out[j] = (unsigned char)value;
+        }
+    } else {
+        unsigned short* out = PGM_ROW16(img, row);
+        for (int j = 0; j < img->width; j++) {
+            if (!readNumber(reader, &value) || value > img->max_gray) return 0;
+            out[j] = (unsigned short)value;
         }
     }
+    return 1;
+}
+
+/**
+ * Lê uma linha de amostras P5 direto no buffer da imagem: 8 bits já é o
+ * formato final; 16 bits vem em big-endian e é convertido no lugar
+ */
+static int readBinaryRow(PGMReader* reader, PGMImage* img, int row) {
+    unsigned char* bytes = PGM_ROW8(img, row);
+    if (!readRaw(reader, bytes, (size_t)img->width * img->sample_bytes)) return 0;
     
-    fclose(file);
-    return img;
+    if (img->sample_bytes == 2) {
+        unsigned short* out = PGM_ROW16(img, row);
+        for (int j = 0; j < img->width; j++) {
+            out[j] = (unsigned short)((bytes[2 * j] << 8) | bytes[2 * j + 1]);
+        }
+    }
+    return 1;
 }
 
 /**
- * Escreve uma imagem em formato PGM ASCII (P2)
+ * Escreve uma imagem PGM no formato em que ela foi lida (P5 se img->binary,
+ * senão P2)
  */
 int writePGM(const char* filename, PGMImage* img) {
-    FILE* file = fopen(filename, "w");
-    if (!file) {
-        fprintf(stderr, "Erro: Não foi possível criar o arquivo %s\n", filename);
+    return writePGMFormat(filename, img, img->binary ? PGM_FORMAT_P5 : PGM_FORMAT_P2);
+}
+
+/**
+ * Escreve uma imagem no formato pedido: P2 (ASCII), P5 (binário, 16 bits
+ * quando max_gray > 255) ou P4 (PBM, só imagens binárias)
+ * As linhas são formatadas num buffer grande, gravado com uma escrita por vez
+ */
+int writePGMFormat(const char* filename, PGMImage* img, int format) {
+    if (format == PGM_FORMAT_P4 && img->max_gray != 1) {
+        fprintf(stderr, "Erro: P4 exige imagem binária (max_gray = 1).\n");
         return 0;
     }
     
-    fprintf(file, "P2\n%d %d\n%d\n", img->width, img->height, img->max_gray);
+    PGMWriter writer;
+    if (!openWriter(&writer, filename)) return 0;
+    writeHeader(&writer, format, img->width, img->height, img->max_gray);
     
     for (int i = 0; i < img->height; i++) {
-        for (int j = 0; j < img->width; j++) {
-            fprintf(file, "%d", img->pixels[i][j]);
-            if (j < img->width - 1) fprintf(file, " ");
+        if (img->sample_bytes == 2) {
+            const unsigned short* row = PGM_ROW16(img, i);
+            if (format == PGM_FORMAT_P5) {
+                unsigned char* out = reserveWriter(&writer, 2 * img->width);
+                for (int j = 0; j < img->width; j++) {
+                    out[2 * j] = (unsigned char)(row[j] >> 8);
+                    out[2 * j + 1] = (unsigned char)row[j];
+                }
+            } else {
+                for (int j = 0; j < img->width; j++) writeSample(&writer, row[j]);
+                writer.buffer[writer.length - 1] = '\n';
+            }
+            continue;
+        }
+        
+        const unsigned char* row = PGM_ROW8(img, i);
+        if (format == PGM_FORMAT_P4) {
+            packBitRow(reserveWriter(&writer, (img->width + 7) / 8), row, img->width);
+        } else if (format == PGM_FORMAT_P5) {
+            memcpy(reserveWriter(&writer, img->width), row, img->width);
+        } else {
+            for (int j = 0; j < img->width; j++) writeSample(&writer, row[j]);
+            writer.buffer[writer.length - 1] = '\n';
         }
-        fprintf(file, "\n");
     }
     
-    fclose(file);
+    return closeWriter(&writer, filename);
+}
+
+/**
+ * Escreve uma imagem binária direto dos dados RLE (sem montar a matriz de
+ * pixels): cada sequência vira um bloco de "0 "/"1 " (P2), de bytes (P5) ou
+ * de bits (P4), quebrado só no fim das linhas
+ */
+int writeRLEAsPGM(const char* filename, const unsigned char* data, int size, int width, int height, int format) {
+    if (size < 1 || width <= 0 || height <= 0) return 0;
+    
+    PGMWriter writer;
+    if (!openWriter(&writer, filename)) return 0;
+    writeHeader(&writer, format, width, height, 1);
+    
+    // P4: linha de bits montada à parte (1 = preto = pixel 0)
+    int row_bytes = (width + 7) / 8;
+    unsigned char* bits = (format == PGM_FORMAT_P4) ? (unsigned char*)malloc(row_bytes) : NULL;
+    if (format == PGM_FORMAT_P4 && !bits) {
+        fclose(writer.file);
+        return 0;
+    }
+    
+    if (run_patterns[0][0] == 0) {
+        for (int j = 0; j < RUN_PATTERN_PAIRS; j++) {
+            run_patterns[0][2 * j] = '0';
+            run_patterns[1][2 * j] = '1';
+            run_patterns[0][2 * j + 1] = run_patterns[1][2 * j + 1] = ' ';
+        }
+    }
+    
+    // Mesma leitura de decompressRLE (formato antigo ou LEB128)
+    RLEReader runs;
+    startRuns(&runs, data, size);
+    unsigned long long remaining = 0;
+    int value = 0;
+    
+    for (int i = 0; i < height; i++) {
+        if (bits) memset(bits, 0, row_bytes);
+        int column = 0;
+        while (column < width) {
+            while (remaining == 0) {
+                if (!nextRun(&runs, &remaining, &value)) {
+                    // Dados curtos: completa com 0
+                    value = 0;
+                    remaining = (unsigned long long)width * height;
+                }
+            }
+            
+            int span = (remaining < (unsigned long long)(width - column)) ? (int)remaining : width - column;
+            if (format == PGM_FORMAT_P2) {
+                for (int done = 0; done < span; ) {
+                    int chunk = (span - done < RUN_PATTERN_PAIRS) ? span - done : RUN_PATTERN_PAIRS;
+                    memcpy(reserveWriter(&writer, 2 * chunk), run_patterns[value], 2 * chunk);
+                    done += chunk;
+                }
+            } else if (format == PGM_FORMAT_P5) {
+                memset(reserveWriter(&writer, span), value, span);
+            } else if (!value) {
+                setBitRange(bits, column, span);
+            }
+            column += span;
+            remaining -= span;
+        }
+        
+        if (format == PGM_FORMAT_P2) {
+            writer.buffer[writer.length - 1] = '\n';
+        } else if (bits) {
+            memcpy(reserveWriter(&writer, row_bytes), bits, row_bytes);
+        }
+    }
+    
+    free(bits);
+    return closeWriter(&writer, filename);
+}
+
+/**
+ * Abre o arquivo sem o buffer do stdio: cada descarga do buffer do escritor
+ * vira uma única escrita
+ */
+static int openWriter(PGMWriter* writer, const char* filename) {
+    writer->file = fopen(filename, "wb");
+    if (!writer->file) {
+        fprintf(stderr, "Erro: Não foi possível criar o arquivo %s\n", filename);
+        return 0;
+    }
+    setvbuf(writer->file, NULL, _IONBF, 0);
+    writer->length = 0;
+    writer->failed = 0;
     return 1;
 }
 
 /**
- * Aplica limiarização para binarizar a imagem
+ * Grava o que está no buffer
+ */
+static void flushWriter(PGMWriter* writer) {
+    if (writer->length > 0 && fwrite(writer->buffer, 1, writer->length, writer->file) != (size_t)writer->length) {
+        writer->failed = 1;
+    }
+    writer->length = 0;
+}
+
+/**
+ * Reserva count bytes contíguos no buffer (count <= PGM_WRITE_BLOCK),
+ * descarregando antes se preciso
+ */
+static unsigned char* reserveWriter(PGMWriter* writer, int count) {
+    if (writer->length + count > PGM_WRITE_BLOCK) flushWriter(writer);
+    unsigned char* out = writer->buffer + writer->length;
+    writer->length += count;
+    return out;
+}
+
+/**
+ * Descarrega o resto e fecha o arquivo; retorna 0 se alguma escrita falhou
+ */
+static int closeWriter(PGMWriter* writer, const char* filename) {
+    flushWriter(writer);
+    if (fclose(writer->file) != 0) writer->failed = 1;
+    if (writer->failed) fprintf(stderr, "Erro: Falha ao gravar o arquivo %s\n", filename);
+    return !writer->failed;
+}
+
+/**
+ * Cabeçalho do formato (P4 não tem max_gray)
+ */
+static void writeHeader(PGMWriter* writer, int format, int width, int height, int max_gray) {
+    char header[64];
+    int length;
+    if (format == PGM_FORMAT_P4) {
+        length = snprintf(header, sizeof(header), "P4\n%d %d\n", width, height);
+    } else {
+        length = snprintf(header, sizeof(header), "P%d\n%d %d\n%d\n", format, width, height, max_gray);
+    }
+    memcpy(reserveWriter(writer, length), header, length);
+}
+
+/**
+ * Escreve a amostra (0 a 65535) seguida de espaço, dois dígitos por vez
+ * pela tabela
+ */
+static void writeSample(PGMWriter* writer, int value) {
+    unsigned char* out = reserveWriter(writer, 6);
+    unsigned char digits[6];
+    int count = 0;
+    unsigned int number = (unsigned int)value;
+    
+    while (number >= 100) {
+        const char* pair = digit_pairs + 2 * (number % 100);
+        digits[count++] = pair[1];
+        digits[count++] = pair[0];
+        number /= 100;
+    }
+    if (number >= 10) {
+        digits[count++] = digit_pairs[2 * number + 1];
+        digits[count++] = digit_pairs[2 * number];
+    } else {
+        digits[count++] = (unsigned char)('0' + number);
+    }
+    
+    for (int i = 0; i < count; i++) out[i] = digits[count - 1 - i];
+    out[count] = ' ';
+    writer->length -= 6 - (count + 1);
+}
+
+/**
+ * Empacota uma linha binária em bits, do mais significativo para o menos
+ * (PBM: 1 = preto, ou seja, pixel 0 da imagem binarizada)
+ */
+static void packBitRow(unsigned char* out, const unsigned char* row, int width) {
+    for (int j = 0; j < width; j += 8) {
+        unsigned char byte = 0;
+        for (int bit = 0; bit < 8; bit++) {
+            byte <<= 1;
+            if (j + bit < width && row[j + bit] == 0) byte |= 1;
+        }
+        out[j / 8] = byte;
+    }
+}
+
+/**
+ * Liga os bits [first, first + count) de uma linha PBM
+ */
+static void setBitRange(unsigned char* bits, int first, int count) {
+    for (int j = first; j < first + count; j++) {
+        bits[j >> 3] |= (unsigned char)(0x80 >> (j & 7));
+    }
+}
+
+/**
+ * Aplica limiarização e devolve a imagem binária empacotada em bits
  * Pixels > threshold viram 1, outros viram 0
+ * Retorna NULL se falta memória
  */
-void binarizeImage(PGMImage* img, int threshold) {
+BinaryImage* binarizeImage(const PGMImage* img, int threshold) {
+    BinaryImage* binary = createBinaryImage(img->width, img->height);
+    if (!binary) return NULL;
+    
     for (int i = 0; i < img->height; i++) {
-        for (int j = 0; j < img->width; j++) {
-            img->pixels[i][j] = (img->pixels[i][j] > threshold) ? 1 : 0;
+        if (img->sample_bytes == 1) {
+            binarizeRow8(PGM_ROW8(img, i), img->width, threshold, BINARY_ROW(binary, i));
+        } else {
+            binarizeRow16(PGM_ROW16(img, i), img->width, threshold, BINARY_ROW(binary, i));
         }
     }
-    img->max_gray = 1;
+    return binary;
 }
 
 /**
@@ -123,97 +602,304 @@ void binarizeImage(PGMImage* img, int threshold) {
  */
 void negativeImage(PGMImage* img) {
     for (int i = 0; i < img->height; i++) {
-        for (int j = 0; j < img->width; j++) {
-            img->pixels[i][j] = img->max_gray - img->pixels[i][j];
+        if (img->sample_bytes == 1) {
+            negateRow8(PGM_ROW8(img, i), img->width, (unsigned char)img->max_gray);
+        } else {
+            negateRow16(PGM_ROW16(img, i), img->width, (unsigned short)img->max_gray);
         }
     }
 }
 
 /**
- * Libera a memória alocada para uma imagem PGM
+ * Libera a memória alocada para uma imagem PGM (estrutura e pixels são um
+ * único bloco)
  */
 void freePGM(PGMImage* img) {
-    if (img) {
-        if (img->pixels) {
-            for (int i = 0; i < img->height; i++) {
-                free(img->pixels[i]);
-            }
-            free(img->pixels);
-        }
-        free(img);
-    }
+    free(img);
+}
+
+/**
+ * Cria uma imagem binária zerada (estrutura e bits num único bloco, bits
+ * alinhados em PGM_ALIGN); NULL se as dimensões são inválidas ou falta memória
+ */
+BinaryImage* createBinaryImage(int width, int height) {
+    if (width <= 0 || height <= 0) return NULL;
+    
+    int words_per_row = (width + 63) / 64;
+    size_t row_bytes = (size_t)words_per_row * sizeof(unsigned long long);
+    if ((size_t)height > ((size_t)-1 - sizeof(BinaryImage) - PGM_ALIGN) / row_bytes) return NULL;
+    
+    BinaryImage* img = (BinaryImage*)calloc(1, sizeof(BinaryImage) + PGM_ALIGN + row_bytes * height);
+    if (!img) return NULL;
+    
+    img->width = width;
+    img->height = height;
+    img->words_per_row = words_per_row;
+    img->bits = (unsigned long long*)(((uintptr_t)(img + 1) + PGM_ALIGN - 1) & ~(uintptr_t)(PGM_ALIGN - 1));
+    return img;
+}
+
+/**
+ * Quantidade de pixels 1 (brancos) da imagem binária, uma palavra por vez
+ */
+long countWhitePixels(const BinaryImage* img) {
+    long count = 0;
+    size_t words = (size_t)img->words_per_row * img->height;
+    for (size_t k = 0; k < words; k++) count += countSetBits(img->bits[k]);
+    return count;
+}
+
+/**
+ * Libera a imagem binária
+ */
+void freeBinaryImage(BinaryImage* img) {
+    free(img);
 }
 
 /**
  * Comprime uma imagem binária usando Run-Length Encoding (RLE)
- * Formato: [primeiro_pixel, count1, count2, ...]
+ * Formato: [RLE_FORMAT_VARINT, primeiro_pixel, count1, count2, ...] com as
+ * contagens em LEB128
  * Retorna array comprimido e atualiza compressed_size
  */
-unsigned char* compressRLE(int** pixels, int width, int height, int* compressed_size) {
-    int total_pixels = width * height;
-    unsigned char* compressed = (unsigned char*)malloc(total_pixels * 2); // Pior caso
+unsigned char* compressRLE(const BinaryImage* img, int* compressed_size) {
+    size_t total_pixels = (size_t)img->width * img->height;
+    unsigned char* compressed = (unsigned char*)malloc(total_pixels + 2 + RLE_VARINT_MAX); // Pior caso: 1 byte por pixel
     
     if (!compressed) return NULL;
     
-    int current_val = pixels[0][0];
-    int count = 1;
-    int comp_index = 0;
+    RLEEncoder encoder;
+    startRLE(&encoder, compressed, (int)(img->bits[0] & 1)); // Primeiro pixel
     
-    compressed[comp_index++] = current_val; // Primeiro pixel
+    for (int i = 0; i < img->height; i++) {
+        encodeRowRLE(&encoder, BINARY_ROW(img, i), img->width);
+    }
+    encoder.length += putVarint(compressed + encoder.length, encoder.count); // Última sequência
     
-    for (int i = 0; i < height; i++) {
-        for (int j = (i == 0 ? 1 : 0); j < width; j++) {
-            if (pixels[i][j] == current_val && count < 255) {
-                count++;
-            } else {
-                compressed[comp_index++] = count;
-                current_val = pixels[i][j];
-                count = 1;
-            }
+    *compressed_size = (int)encoder.length;
+    return (unsigned char*)realloc(compressed, encoder.length);
+}
+
+/**
+ * Lê, limiariza e comprime um PGM linha a linha, gravando o RLE direto em
+ * output (mesmo formato de compressRLE): a memória usada é O(largura),
+ * qualquer que seja a altura da imagem
+ * Retorna 0 em caso de erro (bytes já gravados ficam sem entrada no índice
+ * e são descartados pela compactação)
+ */
+int compressPGMToFile(const char* filename, int threshold, FILE* output, int* width, int* height, int* compressed_size) {
+    PGMReader reader;
+    PGMImage header;
+    if (!readPGMHeader(&reader, filename, &header)) return 0;
+    
+    // Uma linha de amostras, uma de bits e o buffer de saída
+    PGMImage* row = createPGM(header.width, 1, header.max_gray);
+    BinaryImage* bits = createBinaryImage(header.width, 1);
+    unsigned char* out = (unsigned char*)malloc((size_t)header.width + 2 + 2 * RLE_VARINT_MAX + PGM_WRITE_BLOCK);
+    if (!row || !bits || !out) {
+        fprintf(stderr, "Erro: Falha na alocação de memória.\n");
+        freePGM(row);
+        freeBinaryImage(bits);
+        free(out);
+        fclose(reader.file);
+        return 0;
+    }
+    row->binary = header.binary;
+    
+    RLEEncoder encoder = { out, 0, 0, 0 };
+    long written = 0;
+    int ok = 1;
+    
+    for (int i = 0; i < header.height && ok; i++) {
+        if (!readRow(&reader, filename, row, 0, i)) {
+            ok = 0;
+            break;
+        }
+        if (row->sample_bytes == 1) {
+            binarizeRow8(PGM_ROW8(row, 0), header.width, threshold, bits->bits);
+        } else {
+            binarizeRow16(PGM_ROW16(row, 0), header.width, threshold, bits->bits);
         }
+        
+        if (i == 0) startRLE(&encoder, out, (int)(bits->bits[0] & 1));
+        encodeRowRLE(&encoder, bits->bits, header.width);
+        
+        // Buffer cheio: grava e recomeça (a sequência atual continua aberta)
+        if (encoder.length >= PGM_WRITE_BLOCK) {
+            ok = fwrite(out, 1, encoder.length, output) == (size_t)encoder.length;
+            written += encoder.length;
+            encoder.length = 0;
+        }
+    }
+    
+    if (ok) {
+        encoder.length += putVarint(out + encoder.length, encoder.count); // Última sequência
+        ok = fwrite(out, 1, encoder.length, output) == (size_t)encoder.length;
+        written += encoder.length;
+        if (!ok) fprintf(stderr, "Erro: Falha ao gravar os dados comprimidos.\n");
+    }
+    if (ok && written > INT_MAX) {
+        fprintf(stderr, "Erro: Dados comprimidos maiores que o índice suporta.\n");
+        ok = 0;
+    }
+    
+    if (ok) {
+        *width = header.width;
+        *height = header.height;
+        *compressed_size = (int)written;
     }
-    compressed[comp_index++] = count; // Última sequência
     
-    *compressed_size = comp_index;
-    return (unsigned char*)realloc(compressed, comp_index);
+    freePGM(row);
+    freeBinaryImage(bits);
+    free(out);
+    fclose(reader.file);
+    return ok;
 }
 
 /**
- * Descomprime dados RLE para reconstruir matriz de pixels
+ * Inicia o RLE em data: versão do formato e valor do primeiro pixel
  */
-int** decompressRLE(unsigned char* compressed_data, int compressed_size, int width, int height) {
-    int** pixels = (int**)malloc(height * sizeof(int*));
-    if (!pixels) return NULL;
+static void startRLE(RLEEncoder* encoder, unsigned char* data, int first_pixel) {
+    encoder->data = data;
+    encoder->data[0] = RLE_FORMAT_VARINT;
+    encoder->data[1] = (unsigned char)first_pixel;
+    encoder->length = 2;
+    encoder->value = first_pixel;
+    encoder->count = 0;
+}
+
+/**
+ * Acrescenta as sequências de uma linha de bits (tamanho inteiro em LEB128)
+ * Uma palavra por vez: o XOR com o valor atual liga só os pixels que
+ * diferem dele, e o bit ligado mais baixo é a próxima troca de sequência;
+ * palavras todas iguais ao valor atual (só 0 ou só 1) somam 64 de uma vez
+ */
+static void encodeRowRLE(RLEEncoder* encoder, const unsigned long long* row, int width) {
+    int current_val = encoder->value;
+    unsigned long long count = encoder->count;
+    long length = encoder->length;
+    int words = (width + 63) / 64;
     
-    for (int i = 0; i < height; i++) {
-        pixels[i] = (int*)malloc(width * sizeof(int));
-        if (!pixels[i]) {
-            for (int j = 0; j < i; j++) free(pixels[j]);
-            free(pixels);
-            return NULL;
+    for (int k = 0; k < words; k++) {
+        int bits = (k == words - 1 && width % 64) ? width % 64 : 64;
+        unsigned long long valid = (bits == 64) ? ~0ULL : (1ULL << bits) - 1;
+        unsigned long long word = row[k];
+        unsigned long long differ = (word ^ (current_val ? ~0ULL : 0)) & valid;
+        int position = 0;
+        
+        while (differ) {
+            int boundary = lowestSetBit(differ);
+            count += boundary - position;
+            length += putVarint(encoder->data + length, count);
+            current_val = !current_val;
+            count = 0;
+            position = boundary;
+            differ = (word ^ (current_val ? ~0ULL : 0)) & valid & (~0ULL << boundary);
         }
+        count += bits - position;
+    }
+    
+    encoder->value = current_val;
+    encoder->count = count;
+    encoder->length = length;
+}
+
+/**
+ * Grava value em LEB128 (7 bits por byte, bit alto = continua); retorna
+ * quantos bytes foram usados
+ */
+static int putVarint(unsigned char* out, unsigned long long value) {
+    int length = 0;
+    while (value >= 0x80) {
+        out[length++] = (unsigned char)(value | 0x80);
+        value >>= 7;
     }
+    out[length++] = (unsigned char)value;
+    return length;
+}
+
+/**
+ * Descomprime dados RLE (formato antigo ou LEB128) numa imagem binária; as
+ * sequências de 1 são ligadas uma palavra por vez (a imagem nasce zerada)
+ */
+BinaryImage* decompressRLE(unsigned char* compressed_data, int compressed_size, int width, int height) {
+    if (compressed_size < 1) return NULL;
     
-    int current_val = compressed_data[0];
-    int data_index = 1;
-    int pixel_count = 0;
-    int total_processed = 0;
+    BinaryImage* img = createBinaryImage(width, height);
+    if (!img) return NULL;
+    
+    RLEReader runs;
+    startRuns(&runs, compressed_data, compressed_size);
+    unsigned long long pixel_count = 0;
+    int current_val = 0;
     
     for (int i = 0; i < height; i++) {
-        for (int j = 0; j < width; j++) {
-            if (pixel_count == 0) {
-                if (data_index >= compressed_size) break;
-                pixel_count = compressed_data[data_index++];
-            }
-            pixels[i][j] = current_val;
-            pixel_count--;
-            total_processed++;
-            
+        unsigned long long* row = BINARY_ROW(img, i);
+        int j = 0;
+        while (j < width) {
             if (pixel_count == 0) {
-                current_val = !current_val; // Alterna entre 0 e 1
+                if (!nextRun(&runs, &pixel_count, &current_val)) break;   // Dados curtos: resto fica 0
+                continue;
             }
+            int span = (pixel_count < (unsigned long long)(width - j)) ? (int)pixel_count : width - j;
+            if (current_val) setBitRange64(row, j, span);
+            j += span;
+            pixel_count -= span;
         }
     }
     
-    return pixels;
-}
\ No newline at end of file
+    return img;
+}
+
+/**
+ * Prepara a leitura das sequências: registro começando por
+ * RLE_FORMAT_VARINT é LEB128, senão é o formato antigo
+ */
+static void startRuns(RLEReader* reader, const unsigned char* data, int size) {
+    reader->data = data;
+    reader->size = size;
+    reader->varint = (size > 0 && data[0] == RLE_FORMAT_VARINT);
+    reader->index = reader->varint ? 2 : 1;
+    reader->value = (size > reader->index - 1 && data[reader->index - 1]) ? 1 : 0;
+}
+
+/**
+ * Próxima sequência e seu valor (o seguinte é o oposto); contagem 0 só
+ * alterna o valor, como no formato antigo. Retorna 0 no fim dos dados
+ */
+static int nextRun(RLEReader* reader, unsigned long long* length, int* value) {
+    if (reader->index >= reader->size) return 0;
+    
+    if (reader->varint) {
+        unsigned long long count = 0;
+        int shift = 0;
+        unsigned char byte;
+        do {
+            if (reader->index >= reader->size || shift > 63) return 0;   // Contagem truncada
+            byte = reader->data[reader->index++];
+            count |= (unsigned long long)(byte & 0x7F) << shift;
+            shift += 7;
+        } while (byte & 0x80);
+        *length = count;
+    } else {
+        *length = reader->data[reader->index++];
+    }
+    
+    *value = reader->value;
+    reader->value = !reader->value;
+    return 1;
+}
+
+/**
+ * Liga os bits [first, first + count) de uma linha de palavras de 64 bits
+ */
+static void setBitRange64(unsigned long long* row, int first, int count) {
+    int last = first + count;
+    while (first < last) {
+        int bit = first & 63;
+        int n = (last - first < 64 - bit) ? last - first : 64 - bit;
+        unsigned long long mask = (n == 64) ? ~0ULL : ((1ULL << n) - 1) << bit;
+        row[first >> 6] |= mask;
+        first += n;
+    }
+}
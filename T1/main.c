@@ -8,6 +8,7 @@
  * Funcionalidades implementadas:
  * - Compressão RLE de imagens binárias
  * - Armazenamento com arquivo de índices
+ * - Dicionário de nomes: índice com chaves (id do nome, limiar) inteiras
  * - Remoção lógica e compactação física
  * - Recuperação de imagens em formato PGM
  * - Reconstrução da imagem original (Bônus)
@@ -26,13 +27,13 @@ void displayMenu() {
 }
 
 int main() {
-    int choice, threshold;
+    int choice, threshold, format;
     char filename[100], output_name[100];
     
     // Inicializa os arquivos do banco de dados
     initializeDatabase();
     
-    printf("Sistema de Gerenciamento de Imagens Binárias Inicializado\n");
+    printf("Sistema de Gerenciamento de Imagens Binárias Inicializado (kernels: %s)\n", pixelKernelName());
     
     do {
         displayMenu();
@@ -50,13 +51,13 @@ int main() {
                     printf("Erro ao adicionar imagem.\n");
                 }
                 break;
-                
+            
             case 2:
                 if (!listImagesInDatabase()) {
                     printf("Nenhuma imagem encontrada no banco de dados.\n");
                 }
                 break;
-                
+            
             case 3:
                 printf("Nome da imagem: ");
                 scanf("%s", filename);
@@ -68,7 +69,7 @@ int main() {
                     printf("Imagem não encontrada.\n");
                 }
                 break;
-                
+            
             case 4:
                 printf("Nome da imagem: ");
                 scanf("%s", filename);
@@ -76,13 +77,16 @@ int main() {
                 scanf("%d", &threshold);
                 printf("Nome do arquivo de saída: ");
                 scanf("%s", output_name);
-                if (retrieveImageFromDatabase(filename, threshold, output_name)) {
+                printf("Formato de saída (2 = P2, 5 = P5, 4 = P4/PBM): ");
+                scanf("%d", &format);
+                if (format != PGM_FORMAT_P5 && format != PGM_FORMAT_P4) format = PGM_FORMAT_P2;
+                if (retrieveImageFromDatabase(filename, threshold, output_name, format)) {
                     printf("Imagem recuperada: %s\n", output_name);
                 } else {
                     printf("Erro ao recuperar imagem.\n");
                 }
                 break;
-                
+            
             case 5:
                 if (compactDatabase()) {
                     printf("Banco de dados compactado com sucesso!\n");
@@ -90,7 +94,7 @@ int main() {
                     printf("Erro durante a compactação.\n");
                 }
                 break;
-                
+            
             case 6:
                 printf("Nome da imagem para reconstrução: ");
                 scanf("%s", filename);
@@ -102,15 +106,16 @@ int main() {
                     printf("Erro na reconstrução da imagem.\n");
                 }
                 break;
-                
+            
             case 0:
                 printf("Encerrando sistema...\n");
                 break;
-                
+            
             default:
                 printf("Opção inválida!\n");
         }
     } while(choice != 0);
     
+    freeNameDictionary();
     return 0;
 }
\ No newline at end of file
@@ -9,6 +9,9 @@
  * Calcula a imagem média para tentar reconstruir a original
  */
 int reconstructOriginalImage(const char* name, const char* output_filename) {
+    unsigned int name_id = findNameId(name);
+    if (name_id == NAME_NONE) return 0;
+    
     FILE* index_file = fopen("image_index.dat", "rb");
     if (!index_file) return 0;
     
@@ -26,13 +29,13 @@ int reconstructOriginalImage(const char* name, const char* output_filename) {
     
     // Buscar todas as versões não removidas
     while (fread(&entry, sizeof(ImageIndex), 1, index_file)) {
-        if (strcmp(entry.name, name) == 0 && !entry.removed) {
+        if (keyNameId(entry.key) == name_id && !entry.removed) {
             if (version_count >= max_versions) {
                 max_versions *= 2;
                 ImageVersion* temp = (ImageVersion*)realloc(versions, max_versions * sizeof(ImageVersion));
                 if (!temp) {
                     fclose(index_file);
-                    for (int i = 0; i < version_count; i++) freePGM(versions[i].image);
+                    for (int i = 0; i < version_count; i++) freeBinaryImage(versions[i].image);
                     free(versions);
                     return 0;
                 }
@@ -53,18 +56,12 @@ int reconstructOriginalImage(const char* name, const char* output_filename) {
             fread(compressed_data, 1, entry.compressed_size, data_file);
             fclose(data_file);
             
-            int** pixels = decompressRLE(compressed_data, entry.compressed_size, entry.width, entry.height);
+            BinaryImage* image = decompressRLE(compressed_data, entry.compressed_size, entry.width, entry.height);
             free(compressed_data);
             
-            if (pixels) {
-                versions[version_count].threshold = entry.threshold;
-                versions[version_count].image = (PGMImage*)malloc(sizeof(PGMImage));
-                if (versions[version_count].image) {
-                    versions[version_count].image->width = entry.width;
-                    versions[version_count].image->height = entry.height;
-                    versions[version_count].image->max_gray = 255; // Para reconstrução
-                    versions[version_count].image->pixels = pixels;
-                }
+            if (image) {
+                versions[version_count].threshold = keyThreshold(entry.key);
+                versions[version_count].image = image;
                 version_count++;
             }
         }
@@ -85,74 +82,54 @@ int reconstructOriginalImage(const char* name, const char* output_filename) {
     for (int i = 1; i < version_count; i++) {
         if (versions[i].image->width != width || versions[i].image->height != height) {
             printf("Erro: Dimensões inconsistentes entre versões\n");
-            for (int j = 0; j < version_count; j++) freePGM(versions[j].image);
+            for (int j = 0; j < version_count; j++) freeBinaryImage(versions[j].image);
             free(versions);
             return 0;
         }
     }
     
-    // Criar imagem de reconstrução (média)
-    PGMImage* reconstructed = (PGMImage*)malloc(sizeof(PGMImage));
-    if (!reconstructed) {
-        for (int i = 0; i < version_count; i++) freePGM(versions[i].image);
-        free(versions);
-        return 0;
-    }
-    
-    reconstructed->width = width;
-    reconstructed->height = height;
-    reconstructed->max_gray = 255;
-    reconstructed->pixels = (int**)malloc(height * sizeof(int*));
-    
-    if (!reconstructed->pixels) {
-        free(reconstructed);
-        for (int i = 0; i < version_count; i++) freePGM(versions[i].image);
+    // Criar imagem de reconstrução (média) e contador de versões com 1 por pixel
+    PGMImage* reconstructed = createPGM(width, height, 255);
+    unsigned short* ones = (unsigned short*)calloc((size_t)width * height, sizeof(unsigned short));
+    if (!reconstructed || !ones || version_count > 65535) {
+        freePGM(reconstructed);
+        free(ones);
+        for (int i = 0; i < version_count; i++) freeBinaryImage(versions[i].image);
         free(versions);
         return 0;
     }
     
-    // Alocar e inicializar matriz de soma
-    for (int i = 0; i < height; i++) {
-        reconstructed->pixels[i] = (int*)malloc(width * sizeof(int));
-        if (!reconstructed->pixels[i]) {
-            for (int j = 0; j < i; j++) free(reconstructed->pixels[j]);
-            free(reconstructed->pixels);
-            free(reconstructed);
-            for (int k = 0; k < version_count; k++) freePGM(versions[k].image);
-            free(versions);
-            return 0;
-        }
-        memset(reconstructed->pixels[i], 0, width * sizeof(int));
-    }
-    
-    // Somar todas as versões
+    // Somar todas as versões: só os bits ligados de cada palavra são visitados
     for (int v = 0; v < version_count; v++) {
+        printf("  Limiar %d: %ld pixels brancos\n", versions[v].threshold, countWhitePixels(versions[v].image));
         for (int i = 0; i < height; i++) {
-            for (int j = 0; j < width; j++) {
-                // Converter binário (0/1) para escala aproximada
-                int value = versions[v].image->pixels[i][j] * 255;
-                reconstructed->pixels[i][j] += value;
+            const unsigned long long* row = BINARY_ROW(versions[v].image, i);
+            unsigned short* sum = ones + (size_t)i * width;
+            for (int k = 0; k < versions[v].image->words_per_row; k++) {
+                unsigned long long word = row[k];
+                while (word) {
+                    sum[k * 64 + lowestSetBit(word)]++;
+                    word &= word - 1;
+                }
             }
         }
     }
     
-    // Calcular média e normalizar
+    // Média convertida para a escala 0-255
     for (int i = 0; i < height; i++) {
-        for (int j = 0; j < width; j++) {
-            reconstructed->pixels[i][j] /= version_count;
-            // Garantir que está no range 0-255
-            if (reconstructed->pixels[i][j] < 0) reconstructed->pixels[i][j] = 0;
-            if (reconstructed->pixels[i][j] > 255) reconstructed->pixels[i][j] = 255;
-        }
+        const unsigned short* sum = ones + (size_t)i * width;
+        unsigned char* out = PGM_ROW8(reconstructed, i);
+        for (int j = 0; j < width; j++) out[j] = (unsigned char)(sum[j] * 255 / version_count);
     }
+    free(ones);
     
     // Salvar imagem reconstruída
     int success = writePGM(output_filename, reconstructed);
     
     // Liberar memória
     freePGM(reconstructed);
-    for (int i = 0; i < version_count; i++) freePGM(versions[i].image);
+    for (int i = 0; i < version_count; i++) freeBinaryImage(versions[i].image);
     free(versions);
     
     return success;
-}
\ No newline at end of file
+}
@@ -0,0 +1,320 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "image_manager.h"
+
+// Variantes vetoriais só em x86 com GCC/Clang (cada função compilada para o
+// seu conjunto de instruções e escolhida em tempo de execução)
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+// Kernels escolhidos para a CPU atual
+typedef struct {
+    const char* name;
+    void (*binarize8)(const unsigned char* in, int words, unsigned char threshold, unsigned long long* out);
+    void (*binarize16)(const unsigned short* in, int words, unsigned short threshold, unsigned long long* out);
+    int (*negate8)(unsigned char* row, int width, unsigned char max);
+    int (*negate16)(unsigned short* row, int width, unsigned short max);
+} PixelKernels;
+
+static PixelKernels kernels = { NULL, NULL, NULL, NULL, NULL };
+
+// Funções privadas
+static void selectKernels();
+static void binarize8Scalar(const unsigned char* in, int words, unsigned char threshold, unsigned long long* out);
+static void binarize16Scalar(const unsigned short* in, int words, unsigned short threshold, unsigned long long* out);
+static int negate8Scalar(unsigned char* row, int width, unsigned char max);
+static int negate16Scalar(unsigned short* row, int width, unsigned short max);
+#ifdef SIMD_X86
+static void binarize8SSE2(const unsigned char* in, int words, unsigned char threshold, unsigned long long* out);
+static void binarize16SSE2(const unsigned short* in, int words, unsigned short threshold, unsigned long long* out);
+static int negate8SSE2(unsigned char* row, int width, unsigned char max);
+static int negate16SSE2(unsigned short* row, int width, unsigned short max);
+static void binarize8AVX2(const unsigned char* in, int words, unsigned char threshold, unsigned long long* out);
+static void binarize16AVX2(const unsigned short* in, int words, unsigned short threshold, unsigned long long* out);
+static int negate8AVX2(unsigned char* row, int width, unsigned char max);
+static int negate16AVX2(unsigned short* row, int width, unsigned short max);
+static void binarize8AVX512(const unsigned char* in, int words, unsigned char threshold, unsigned long long* out);
+static void binarize16AVX512(const unsigned short* in, int words, unsigned short threshold, unsigned long long* out);
+static int negate8AVX512(unsigned char* row, int width, unsigned char max);
+static int negate16AVX512(unsigned short* row, int width, unsigned short max);
+#endif
+
+/**
+ * Escolhe a melhor variante suportada pela CPU (AVX-512, AVX2, SSE2 ou escalar)
+ */
+static void selectKernels() {
+    PixelKernels selected = { "escalar", binarize8Scalar, binarize16Scalar, negate8Scalar, negate16Scalar };
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512bw")) {
+        PixelKernels avx512 = { "AVX-512", binarize8AVX512, binarize16AVX512, negate8AVX512, negate16AVX512 };
+        selected = avx512;
+    } else if (__builtin_cpu_supports("avx2")) {
+        PixelKernels avx2 = { "AVX2", binarize8AVX2, binarize16AVX2, negate8AVX2, negate16AVX2 };
+        selected = avx2;
+    } else if (__builtin_cpu_supports("sse2")) {
+        PixelKernels sse2 = { "SSE2", binarize8SSE2, binarize16SSE2, negate8SSE2, negate16SSE2 };
+        selected = sse2;
+    }
+#endif
+    kernels = selected;
+}
+
+/**
+ * Nome da variante de kernels em uso
+ */
+const char* pixelKernelName() {
+    if (!kernels.name) selectKernels();
+    return kernels.name;
+}
+
+/**
+ * Limiariza uma linha de amostras de 8 bits direto para bits (pixel > limiar
+ * vira 1): out recebe (width + 63) / 64 palavras, bits de sobra em 0
+ */
+void binarizeRow8(const unsigned char* in, int width, int threshold, unsigned long long* out) {
+    int words = (width + 63) / 64;
+    
+    if (threshold < 0 || threshold >= 255) {
+        // Limiar fora da faixa: tudo 1 ou tudo 0
+        unsigned long long fill = threshold < 0 ? ~0ULL : 0;
+        for (int k = 0; k < words; k++) out[k] = fill;
+    } else {
+        if (!kernels.binarize8) selectKernels();
+        kernels.binarize8(in, width / 64, (unsigned char)threshold, out);
+        for (int j = width & ~63; j < width; j++) {
+            if (j % 64 == 0) out[j / 64] = 0;
+            out[j / 64] |= (unsigned long long)(in[j] > threshold) << (j % 64);
+        }
+    }
+    if (width % 64) out[words - 1] &= ~0ULL >> (64 - width % 64);
+}
+
+/**
+ * Limiariza uma linha de amostras de 16 bits direto para bits
+ */
+void binarizeRow16(const unsigned short* in, int width, int threshold, unsigned long long* out) {
+    int words = (width + 63) / 64;
+    
+    if (threshold < 0 || threshold >= 65535) {
+        unsigned long long fill = threshold < 0 ? ~0ULL : 0;
+        for (int k = 0; k < words; k++) out[k] = fill;
+    } else {
+        if (!kernels.binarize16) selectKernels();
+        kernels.binarize16(in, width / 64, (unsigned short)threshold, out);
+        for (int j = width & ~63; j < width; j++) {
+            if (j % 64 == 0) out[j / 64] = 0;
+            out[j / 64] |= (unsigned long long)(in[j] > threshold) << (j % 64);
+        }
+    }
+    if (width % 64) out[words - 1] &= ~0ULL >> (64 - width % 64);
+}
+
+/**
+ * Negativa uma linha de 8 bits (max - amostra)
+ */
+void negateRow8(unsigned char* row, int width, unsigned char max) {
+    if (!kernels.negate8) selectKernels();
+    int done = kernels.negate8(row, width, max);
+    for (int j = done; j < width; j++) row[j] = max - row[j];
+}
+
+/**
+ * Negativa uma linha de 16 bits (max - amostra)
+ */
+void negateRow16(unsigned short* row, int width, unsigned short max) {
+    if (!kernels.negate16) selectKernels();
+    int done = kernels.negate16(row, width, max);
+    for (int j = done; j < width; j++) row[j] = max - row[j];
+}
+
+// Variante escalar: words palavras completas (64 amostras cada), sem desvios
+
+static void binarize8Scalar(const unsigned char* in, int words, unsigned char threshold, unsigned long long* out) {
+    for (int k = 0; k < words; k++, in += 64) {
+        unsigned long long word = 0;
+        for (int b = 0; b < 64; b++) word |= (unsigned long long)(in[b] > threshold) << b;
+        out[k] = word;
+    }
+}
+
+static void binarize16Scalar(const unsigned short* in, int words, unsigned short threshold, unsigned long long* out) {
+    for (int k = 0; k < words; k++, in += 64) {
+        unsigned long long word = 0;
+        for (int b = 0; b < 64; b++) word |= (unsigned long long)(in[b] > threshold) << b;
+        out[k] = word;
+    }
+}
+
+// Negação escalar: nada é feito aqui, o restante da linha fica com o chamador
+static int negate8Scalar(unsigned char* row, int width, unsigned char max) {
+    (void)row; (void)width; (void)max;
+    return 0;
+}
+
+static int negate16Scalar(unsigned short* row, int width, unsigned short max) {
+    (void)row; (void)width; (void)max;
+    return 0;
+}
+
+#ifdef SIMD_X86
+
+// SSE2: 16 amostras de 8 bits por comparação; sem comparação sem sinal, os
+// dois lados são deslocados por 0x80 (0x8000 em 16 bits) e comparados com sinal
+
+__attribute__((target("sse2")))
+static void binarize8SSE2(const unsigned char* in, int words, unsigned char threshold, unsigned long long* out) {
+    const __m128i bias = _mm_set1_epi8((char)0x80);
+    const __m128i limit = _mm_set1_epi8((char)(threshold ^ 0x80));
+    for (int k = 0; k < words; k++, in += 64) {
+        unsigned long long word = 0;
+        for (int part = 0; part < 4; part++) {
+            __m128i v = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(in + part * 16)), bias);
+            unsigned long long mask = (unsigned)_mm_movemask_epi8(_mm_cmpgt_epi8(v, limit));
+            word |= mask << (part * 16);
+        }
+        out[k] = word;
+    }
+}
+
+__attribute__((target("sse2")))
+static void binarize16SSE2(const unsigned short* in, int words, unsigned short threshold, unsigned long long* out) {
+    const __m128i bias = _mm_set1_epi16((short)0x8000);
+    const __m128i limit = _mm_set1_epi16((short)(threshold ^ 0x8000));
+    for (int k = 0; k < words; k++, in += 64) {
+        unsigned long long word = 0;
+        for (int part = 0; part < 4; part++) {
+            __m128i a = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(in + part * 16)), bias);
+            __m128i b = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(in + part * 16 + 8)), bias);
+            __m128i packed = _mm_packs_epi16(_mm_cmpgt_epi16(a, limit), _mm_cmpgt_epi16(b, limit));
+            unsigned long long mask = (unsigned)_mm_movemask_epi8(packed);
+            word |= mask << (part * 16);
+        }
+        out[k] = word;
+    }
+}
+
+__attribute__((target("sse2")))
+static int negate8SSE2(unsigned char* row, int width, unsigned char max) {
+    const __m128i top = _mm_set1_epi8((char)max);
+    int j = 0;
+    for (; j + 16 <= width; j += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(row + j));
+        _mm_storeu_si128((__m128i*)(row + j), _mm_sub_epi8(top, v));
+    }
+    return j;
+}
+
+__attribute__((target("sse2")))
+static int negate16SSE2(unsigned short* row, int width, unsigned short max) {
+    const __m128i top = _mm_set1_epi16((short)max);
+    int j = 0;
+    for (; j + 8 <= width; j += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(row + j));
+        _mm_storeu_si128((__m128i*)(row + j), _mm_sub_epi16(top, v));
+    }
+    return j;
+}
+
+// AVX2: 32 amostras de 8 bits por comparação; em 16 bits o empacotamento
+// intercala as metades de 128 bits, reordenadas antes da máscara
+
+__attribute__((target("avx2")))
+static void binarize8AVX2(const unsigned char* in, int words, unsigned char threshold, unsigned long long* out) {
+    const __m256i bias = _mm256_set1_epi8((char)0x80);
+    const __m256i limit = _mm256_set1_epi8((char)(threshold ^ 0x80));
+    for (int k = 0; k < words; k++, in += 64) {
+        __m256i low = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)in), bias);
+        __m256i high = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(in + 32)), bias);
+        unsigned long long mask_low = (unsigned)_mm256_movemask_epi8(_mm256_cmpgt_epi8(low, limit));
+        unsigned long long mask_high = (unsigned)_mm256_movemask_epi8(_mm256_cmpgt_epi8(high, limit));
+        out[k] = mask_low | mask_high << 32;
+    }
+}
+
+__attribute__((target("avx2")))
+static void binarize16AVX2(const unsigned short* in, int words, unsigned short threshold, unsigned long long* out) {
+    const __m256i bias = _mm256_set1_epi16((short)0x8000);
+    const __m256i limit = _mm256_set1_epi16((short)(threshold ^ 0x8000));
+    for (int k = 0; k < words; k++, in += 64) {
+        unsigned long long word = 0;
+        for (int part = 0; part < 2; part++) {
+            __m256i a = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(in + part * 32)), bias);
+            __m256i b = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(in + part * 32 + 16)), bias);
+            __m256i packed = _mm256_packs_epi16(_mm256_cmpgt_epi16(a, limit), _mm256_cmpgt_epi16(b, limit));
+            packed = _mm256_permute4x64_epi64(packed, 0xD8);
+            unsigned long long mask = (unsigned)_mm256_movemask_epi8(packed);
+            word |= mask << (part * 32);
+        }
+        out[k] = word;
+    }
+}
+
+__attribute__((target("avx2")))
+static int negate8AVX2(unsigned char* row, int width, unsigned char max) {
+    const __m256i top = _mm256_set1_epi8((char)max);
+    int j = 0;
+    for (; j + 32 <= width; j += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(row + j));
+        _mm256_storeu_si256((__m256i*)(row + j), _mm256_sub_epi8(top, v));
+    }
+    return j;
+}
+
+__attribute__((target("avx2")))
+static int negate16AVX2(unsigned short* row, int width, unsigned short max) {
+    const __m256i top = _mm256_set1_epi16((short)max);
+    int j = 0;
+    for (; j + 16 <= width; j += 16) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(row + j));
+        _mm256_storeu_si256((__m256i*)(row + j), _mm256_sub_epi16(top, v));
+    }
+    return j;
+}
+
+// AVX-512BW: a comparação sem sinal já devolve a máscara de 64 (ou 32) bits
+
+__attribute__((target("avx512f,avx512bw")))
+static void binarize8AVX512(const unsigned char* in, int words, unsigned char threshold, unsigned long long* out) {
+    const __m512i limit = _mm512_set1_epi8((char)threshold);
+    for (int k = 0; k < words; k++, in += 64) {
+        out[k] = _mm512_cmpgt_epu8_mask(_mm512_loadu_si512((const void*)in), limit);
+    }
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void binarize16AVX512(const unsigned short* in, int words, unsigned short threshold, unsigned long long* out) {
+    const __m512i limit = _mm512_set1_epi16((short)threshold);
+    for (int k = 0; k < words; k++, in += 64) {
+        unsigned long long low = _mm512_cmpgt_epu16_mask(_mm512_loadu_si512((const void*)in), limit);
+        unsigned long long high = _mm512_cmpgt_epu16_mask(_mm512_loadu_si512((const void*)(in + 32)), limit);
+        out[k] = low | high << 32;
+    }
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static int negate8AVX512(unsigned char* row, int width, unsigned char max) {
+    const __m512i top = _mm512_set1_epi8((char)max);
+    int j = 0;
+    for (; j + 64 <= width; j += 64) {
+        __m512i v = _mm512_loadu_si512((const void*)(row + j));
+        _mm512_storeu_si512((void*)(row + j), _mm512_sub_epi8(top, v));
+    }
+    return j;
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static int negate16AVX512(unsigned short* row, int width, unsigned short max) {
+    const __m512i top = _mm512_set1_epi16((short)max);
+    int j = 0;
+    for (; j + 32 <= width; j += 32) {
+        __m512i v = _mm512_loadu_si512((const void*)(row + j));
+        _mm512_storeu_si512((void*)(row + j), _mm512_sub_epi16(top, v));
+    }
+    return j;
+}
+
+#endif
@@ -34,4 +34,36 @@ void printImageInfo(PGMImage* img) {
  */
 int isRemoved(ImageIndex* entry) {
     return (entry == NULL) ? 1 : entry->removed;
-}
\ No newline at end of file
+}
+
+/**
+ * Quantidade de bits ligados na palavra
+ */
+int countSetBits(unsigned long long word) {
+#if defined(__GNUC__)
+    return __builtin_popcountll(word);
+#else
+    int count = 0;
+    while (word) {
+        word &= word - 1;
+        count++;
+    }
+    return count;
+#endif
+}
+
+/**
+ * Posição do bit ligado menos significativo (a palavra não pode ser 0)
+ */
+int lowestSetBit(unsigned long long word) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(word);
+#else
+    int position = 0;
+    while (!(word & 1)) {
+        word >>= 1;
+        position++;
+    }
+    return position;
+#endif
+}
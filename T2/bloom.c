@@ -0,0 +1,229 @@
+#include "bloom.h"
+#include <math.h>
+
+#define BLOOM_LN2 0.69314718055994530942
+
+// Cabeçalho do arquivo do filtro (seguido de bit_count / 8 bytes)
+typedef struct {
+    char magic[8];
+    long bit_count;
+    int hash_count;
+    long capacity;
+    double fp_rate;
+    long added;
+    long removed;
+    long stamp;
+} BloomFileHeader;
+
+// Funções privadas
+static void bloom_hash(unsigned long long key, unsigned long long* h1, unsigned long long* h2);
+static BloomFilter* bloom_alloc(long bit_count, int hash_count);
+
+/**
+ * Cria filtro vazio para capacity chaves com a taxa de falsos positivos
+ * desejada; max_bytes > 0 limita a memória (a taxa real fica maior)
+ */
+BloomFilter* bloom_create(long capacity, double fp_rate, long max_bytes) {
+    if (capacity < BLOOM_MIN_CAPACITY) capacity = BLOOM_MIN_CAPACITY;
+    if (fp_rate <= 0.0 || fp_rate >= 1.0) fp_rate = 0.01;
+
+    // m = -n ln(p) / (ln 2)^2 bits e k = (m / n) ln 2 funções de espalhamento
+    double bits = -(double)capacity * log(fp_rate) / (BLOOM_LN2 * BLOOM_LN2);
+    if (max_bytes > 0 && bits > (double)max_bytes * 8) bits = (double)max_bytes * 8;
+
+    long bit_count = ((long)bits + 63) / 64 * 64;
+    if (bit_count < 64) bit_count = 64;
+
+    int hash_count = (int)((double)bit_count / capacity * BLOOM_LN2 + 0.5);
+    if (hash_count < 1) hash_count = 1;
+    if (hash_count > BLOOM_MAX_HASHES) hash_count = BLOOM_MAX_HASHES;
+
+    BloomFilter* filter = bloom_alloc(bit_count, hash_count);
+    if (!filter) return NULL;
+
+    filter->capacity = capacity;
+    filter->fp_rate = fp_rate;
+    return filter;
+}
+
+/**
+ * Libera o filtro
+ */
+void bloom_free(BloomFilter* filter) {
+    if (!filter) return;
+
+    free(filter->bits);
+    free(filter);
+}
+
+/**
+ * Acrescenta a chave de 64 bits do índice ao filtro
+ * Os bits são ligados de forma atômica: leitores podem consultar ao mesmo tempo
+ */
+void bloom_add(BloomFilter* filter, unsigned long long key) {
+    unsigned long long h1, h2;
+    bloom_hash(key, &h1, &h2);
+
+    for (int i = 0; i < filter->hash_count; i++) {
+        unsigned long long bit = (h1 + (unsigned long long)i * h2) % (unsigned long long)filter->bit_count;
+        __atomic_fetch_or(&filter->bits[bit / 64], 1ULL << (bit % 64), __ATOMIC_RELAXED);
+    }
+    __atomic_add_fetch(&filter->added, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * Retorna 0 se a chave certamente não está no índice
+ */
+int bloom_may_contain(BloomFilter* filter, unsigned long long key) {
+    unsigned long long h1, h2;
+    bloom_hash(key, &h1, &h2);
+    __atomic_add_fetch(&filter->queries, 1, __ATOMIC_RELAXED);
+
+    for (int i = 0; i < filter->hash_count; i++) {
+        unsigned long long bit = (h1 + (unsigned long long)i * h2) % (unsigned long long)filter->bit_count;
+        unsigned long long word = __atomic_load_n(&filter->bits[bit / 64], __ATOMIC_RELAXED);
+        if (!(word & (1ULL << (bit % 64)))) {
+            __atomic_add_fetch(&filter->rejected, 1, __ATOMIC_RELAXED);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+/**
+ * Registra que o filtro disse "pode estar" para uma chave ausente
+ */
+void bloom_note_false_positive(BloomFilter* filter) {
+    __atomic_add_fetch(&filter->false_positives, 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * Taxa de falsos positivos estimada: (1 - e^(-k n / m))^k
+ * n conta também as chaves removidas, cujos bits continuam ligados
+ */
+double bloom_estimated_fp(const BloomFilter* filter) {
+    double exponent = -(double)filter->hash_count * filter->added / filter->bit_count;
+    return pow(1.0 - exp(exponent), filter->hash_count);
+}
+
+/**
+ * Grava o filtro (arquivo temporário + rename: nunca fica meio gravado)
+ */
+int bloom_save(const BloomFilter* filter, const char* filename) {
+    char temp_name[256];
+    snprintf(temp_name, sizeof(temp_name), "%s.tmp", filename);
+
+    FILE* file = fopen(temp_name, "wb");
+    if (!file) {
+        fprintf(stderr, "Erro: Não foi possível gravar %s\n", temp_name);
+        return 0;
+    }
+
+    BloomFileHeader header;
+    memset(&header, 0, sizeof(BloomFileHeader));
+    memcpy(header.magic, BLOOM_MAGIC, sizeof(header.magic));
+    header.bit_count = filter->bit_count;
+    header.hash_count = filter->hash_count;
+    header.capacity = filter->capacity;
+    header.fp_rate = filter->fp_rate;
+    header.added = filter->added;
+    header.removed = filter->removed;
+    header.stamp = filter->stamp;
+
+    int ok = fwrite(&header, sizeof(BloomFileHeader), 1, file) == 1 &&
+             fwrite(filter->bits, filter->bit_count / 8, 1, file) == 1;
+    ok = (fclose(file) == 0) && ok;
+
+    remove(filename);
+    if (!ok || rename(temp_name, filename) != 0) {
+        fprintf(stderr, "Erro: Falha ao gravar %s\n", filename);
+        remove(temp_name);
+        return 0;
+    }
+    return 1;
+}
+
+/**
+ * Lê o filtro gravado (NULL se não existe ou está inválido)
+ */
+BloomFilter* bloom_load(const char* filename) {
+    FILE* file = fopen(filename, "rb");
+    if (!file) return NULL;
+
+    BloomFileHeader header;
+    if (fread(&header, sizeof(BloomFileHeader), 1, file) != 1 ||
+        memcmp(header.magic, BLOOM_MAGIC, sizeof(header.magic)) != 0 ||
+        header.bit_count <= 0 || header.bit_count % 64 != 0 ||
+        header.hash_count < 1 || header.hash_count > BLOOM_MAX_HASHES) {
+        fclose(file);
+        return NULL;
+    }
+
+    BloomFilter* filter = bloom_alloc(header.bit_count, header.hash_count);
+    if (!filter) {
+        fclose(file);
+        return NULL;
+    }
+
+    if (fread(filter->bits, header.bit_count / 8, 1, file) != 1) {
+        fclose(file);
+        bloom_free(filter);
+        return NULL;
+    }
+    fclose(file);
+
+    filter->capacity = header.capacity;
+    filter->fp_rate = header.fp_rate;
+    filter->added = header.added;
+    filter->removed = header.removed;
+    filter->stamp = header.stamp;
+    return filter;
+}
+
+/**
+ * Imprime tamanho, taxa configurada/estimada e eficácia do filtro
+ */
+void bloom_print_stats(const BloomFilter* filter) {
+    printf("Filtro de Bloom: %ld KiB, %d funções, capacidade %ld chaves | "
+           "Falsos positivos: alvo %.2f%%, estimado %.2f%% (%ld inseridas, %ld removidas)\n",
+           filter->bit_count / 8 / 1024, filter->hash_count, filter->capacity,
+           100.0 * filter->fp_rate, 100.0 * bloom_estimated_fp(filter),
+           filter->added, filter->removed);
+    printf("Consultas: %ld | Rejeitadas sem descer na árvore: %ld | Falsos positivos: %ld\n",
+           filter->queries, filter->rejected, filter->false_positives);
+}
+
+/**
+ * Duas funções de espalhamento a partir da chave de 64 bits (mistura final
+ * do MurmurHash3: ids e limiares próximos caem longe); as k posições são
+ * h1 + i * h2 (espalhamento duplo)
+ */
+static void bloom_hash(unsigned long long key, unsigned long long* h1, unsigned long long* h2) {
+    unsigned long long hash = key ^ 0x9E3779B97F4A7C15ULL;
+
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+
+    *h1 = hash;
+    *h2 = (hash >> 32 | hash << 32) | 1;
+}
+
+/**
+ * Aloca filtro com todos os bits desligados
+ */
+static BloomFilter* bloom_alloc(long bit_count, int hash_count) {
+    BloomFilter* filter = calloc(1, sizeof(BloomFilter));
+    if (!filter) return NULL;
+
+    filter->bits = calloc(bit_count / 64, sizeof(unsigned long long));
+    if (!filter->bits) {
+        free(filter);
+        return NULL;
+    }
+    filter->bit_count = bit_count;
+    filter->hash_count = hash_count;
+    return filter;
+}
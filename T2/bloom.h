@@ -0,0 +1,39 @@
+#ifndef BLOOM_H
+#define BLOOM_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BLOOM_MAGIC "BTBLOOM2"
+#define BLOOM_MIN_CAPACITY 1024
+#define BLOOM_MAX_HASHES 16
+
+// Filtro de Bloom: "não está" é certeza, "pode estar" tem falso positivo
+// Chaves são as do índice: (name_id, limiar) em 64 bits
+// Dimensionado para capacity chaves com taxa fp_rate (limitado a max_bytes)
+typedef struct {
+    unsigned long long* bits;
+    long bit_count;
+    int hash_count;
+    long capacity;
+    double fp_rate;
+    long added;       // chaves inseridas desde a construção
+    long removed;     // chaves removidas (os bits continuam ligados)
+    long stamp;       // checkpoint do índice em que o filtro foi gravado
+    long queries;
+    long rejected;
+    long false_positives;
+} BloomFilter;
+
+BloomFilter* bloom_create(long capacity, double fp_rate, long max_bytes);
+void bloom_free(BloomFilter* filter);
+void bloom_add(BloomFilter* filter, unsigned long long key);
+int bloom_may_contain(BloomFilter* filter, unsigned long long key);
+void bloom_note_false_positive(BloomFilter* filter);
+double bloom_estimated_fp(const BloomFilter* filter);
+int bloom_save(const BloomFilter* filter, const char* filename);
+BloomFilter* bloom_load(const char* filename);
+void bloom_print_stats(const BloomFilter* filter);
+
+#endif
@@ -1,642 +1,2381 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
 #include "btree.h"
+#include "pager.h"
+#include "wal.h"
+#include "bloom.h"
+#include "names.h"
+#include <limits.h>
+#include <pthread.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
 
 // Variáveis estáticas - encapsulamento completo
 static BTreeHeader btree_header;
 static BTreeNode* btree_root = NULL;
+static int btree_header_dirty = 0;
+static int btree_requested_order = 0;
+static int btree_order = 0;
+static int btree_max_keys = 0;
+static int btree_min_keys = 0;
+
+// Páginas modificadas pela operação em andamento (ficam fixadas até o commit,
+// então nenhuma página sem registro no log chega ao btree.dat)
+static BTreeNode** btree_txn_pages = NULL;
+static int btree_txn_count = 0;
+static int btree_txn_capacity = 0;
+static int btree_wal_group = WAL_DEFAULT_GROUP;
+static int btree_wal_enabled = 0;
+static int btree_use_mmap = 0;
+static int btree_read_only = 0;
+
+// Inserções em ordem crescente (nomes com data, limiares de uma imagem):
+// a última folha é guardada para inserir sem descer e, enquanto as chaves
+// chegam sempre no fim, as divisões deixam a página da esquerda cheia
+static long btree_rightmost_leaf = -1;
+static int btree_last_append = 0;
+
+// Filtro de Bloom das chaves: buscas por chaves ausentes param antes da raiz
+// Chave removida continua "talvez presente" até o filtro ser reconstruído
+// Filtros substituídos com leitores ativos só são liberados com a árvore
+// travada de forma exclusiva (carga em lote, compactação, fechamento)
+static BloomFilter* btree_bloom = NULL;
+static BloomFilter** btree_bloom_retired = NULL;
+static int btree_bloom_retired_count = 0;
+static double btree_bloom_fp = BTREE_BLOOM_FP;
+static long btree_bloom_max_bytes = BTREE_BLOOM_MAX_BYTES;
+static int btree_bloom_dirty = 0;
+static int btree_bloom_stale = 0;
+
+// Concorrência: leitores descem com travas compartilhadas acopladas (crabbing)
+// e escritores com travas exclusivas; os escritores são serializados entre si
+// (conjunto de escrita, cabeçalho e lista de livres são únicos)
+// Ordem de aquisição: btree_tree_latch -> btree_write_mutex -> btree_root_latch
+// -> páginas de cima para baixo (irmãos só com o pai travado)
+static pthread_rwlock_t btree_tree_latch = PTHREAD_RWLOCK_INITIALIZER;
+static pthread_mutex_t btree_write_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_rwlock_t btree_root_latch = PTHREAD_RWLOCK_INITIALIZER;
+
+// Chave da versão 1 (nome de tamanho fixo)
+#define LEGACY_NAME_LEN 50
+
+typedef struct {
+    char name[LEGACY_NAME_LEN];
+    int threshold;
+    long data_offset;
+    int data_size;
+    int width;
+    int height;
+} LegacyBTreeKey;
+
+// Nó do formato original (versão 1: ordem 3 fixa, sem página de cabeçalho)
+#define LEGACY_ORDER 3
+
+typedef struct {
+    int is_leaf;
+    int num_keys;
+    long children[LEGACY_ORDER];
+    LegacyBTreeKey keys[LEGACY_ORDER - 1];
+    long self_offset;
+} LegacyBTreeNode;
+
+typedef struct {
+    long root_offset;
+    long free_offset;
+    int node_count;
+} LegacyBTreeHeader;
 
 // Funções privadas
+static void btree_set_limits(int order);
+static void btree_format_header();
+static int btree_bulk_node_count(int items, int target, int min, int max);
+static int btree_bulk_plan(int items, int is_leaf, int fill_percent, int* sizes);
+static int btree_read_legacy(const char* filename, BTreeKey** keys, int* count);
+static void btree_collect_legacy(FILE* file, long file_size, long offset, int depth,
+                                 BTreeKey** keys, int* count, int* capacity);
+static int btree_append_key(BTreeKey** keys, int* count, int* capacity, const BTreeKey* key);
+static int btree_append_legacy(BTreeKey** keys, int* count, int* capacity, const LegacyBTreeKey* key);
+static int btree_compare_key_ptrs(const void* a, const void* b);
 static long btree_create_node(int is_leaf);
-static BTreeNode* btree_read_node(long offset);
-static void btree_write_node(long offset, BTreeNode* node);
+static void btree_free_node(BTreeNode* node);
 static void btree_update_header();
+static void btree_set_root(long offset);
+static BTreeNode* btree_lock_node(long offset);
+static void btree_flush_locked();
+static int btree_check_writable();
+static void btree_bloom_reset(long capacity);
+static void btree_bloom_load(int recovered);
+static void btree_bloom_rebuild();
+static void btree_bloom_install(BloomFilter* filter);
+static void btree_bloom_free_retired();
+static void btree_bloom_refresh();
+static void btree_bloom_save();
+static void btree_bloom_touch();
+static int btree_rebuild(BTreeKey* keys, int count, int fill_percent);
+static int btree_replace_file(const char* temp_name, const char* filename);
+static void btree_relocate_finish();
+static void btree_sync_file(const char* filename);
+static void btree_track_page(BTreeNode* node);
+static void btree_commit();
+static void btree_checkpoint();
+static void btree_apply_log(long offset, const void* data, int size);
 static int btree_compare_keys(const BTreeKey* a, const BTreeKey* b);
-static void btree_split_child(BTreeNode* parent, int index, BTreeNode* child);
-static void btree_insert_non_full(BTreeNode* node, BTreeKey key);
-static int btree_delete_recursive(long node_offset, BTreeKey key);
-static void btree_remove_from_leaf(long node_offset, int idx);
-static void btree_remove_from_non_leaf(long node_offset, int idx);
-static BTreeKey btree_get_predecessor(long node_offset, int idx);
-static BTreeKey btree_get_successor(long node_offset, int idx);
-static void btree_fill_child(long node_offset, int idx);
-static void btree_borrow_from_prev(long node_offset, int idx);
-static void btree_borrow_from_next(long node_offset, int idx);
-static void btree_merge(long node_offset, int idx);
-static int btree_find_key_index(BTreeNode* node, const BTreeKey* key);
+static unsigned long long btree_key_value(unsigned int name_id, int threshold);
+static unsigned long long btree_key_of(const BTreeKey* key);
+static int btree_key_threshold(unsigned long long value);
+static int btree_intern_key(BTreeKey* key);
+static BTreeSlot* btree_slots(const BTreeNode* node);
+static int btree_value_size(const BTreeNode* node);
+static unsigned char* btree_node_record(const BTreeNode* node, int index);
+static void btree_store_value(unsigned char* record, const BTreeKey* key);
+static void btree_node_store(BTreeNode* node, unsigned long long key, const void* record, BTreeSlot* slot);
+static int btree_node_free_space(const BTreeNode* node);
+static int btree_node_full(const BTreeNode* node);
+static int btree_node_minimal(const BTreeNode* node);
+static int btree_node_can_lend(const BTreeNode* node);
+static void btree_node_insert(BTreeNode* node, int index, unsigned long long key, const void* record);
+static void btree_node_append(BTreeNode* node, const BTreeNode* source, int from, int count);
+static void btree_node_remove(BTreeNode* node, int index);
+static void btree_node_truncate(BTreeNode* node, int count);
+static void btree_node_compact(BTreeNode* node);
+static BTreeNode* btree_find_leaf(unsigned long long key);
+static BTreeNode* btree_find_leaf_exclusive(unsigned long long key);
+static int btree_search_optimistic(unsigned long long key, BTreeKey* result, int* found);
+static void btree_cursor_start(BTreeCursor* cursor, unsigned int name_id, int threshold);
+static void btree_cursor_position(BTreeCursor* cursor);
+static int btree_cursor_settle(BTreeCursor* cursor);
+static int btree_cursor_next(BTreeCursor* cursor, BTreeKey* key);
+static BTreeNode* btree_step_right(BTreeNode* leaf);
+static void btree_split_child(BTreeNode* parent, int index, BTreeNode* child, const unsigned long long* append_key);
+static BTreeNode* btree_insert_find_leaf(unsigned long long key, unsigned long long* bound, int* has_bound);
+static BTreeNode* btree_insert_root(unsigned long long key);
+static BTreeNode* btree_insert_descend(BTreeNode* node, unsigned long long key, unsigned long long* bound, int* has_bound);
+static void btree_insert_into_leaf(BTreeNode* leaf, const BTreeKey* keys, int count);
+static int btree_is_append(BTreeNode* node, unsigned long long key);
+static void btree_bloom_add_keys(const BTreeKey* keys, int count);
+static void btree_remove_from_leaf(BTreeNode* leaf, int idx);
+static BTreeNode* btree_fill_child(BTreeNode* node, int idx, BTreeNode* child);
+static void btree_borrow_from_prev(BTreeNode* node, int idx, BTreeNode* child, BTreeNode* left_sibling);
+static void btree_borrow_from_next(BTreeNode* node, int idx, BTreeNode* child, BTreeNode* right_sibling);
+static int btree_merge(BTreeNode* node, int idx, BTreeNode* child, BTreeNode* right_sibling);
+static int btree_find_key_index(BTreeNode* node, unsigned long long key);
+static int btree_find_child_index(BTreeNode* node, unsigned long long key);
+
+/**
+ * Define a ordem usada ao criar um novo arquivo (0 = maior que cabe na página)
+ * Arquivos existentes mantêm a ordem gravada no cabeçalho
+ */
+void btree_set_order(int order) {
+    btree_requested_order = order;
+}
+
+/**
+ * Define quantos commits dividem um fsync do log (0 = sem log)
+ * Deve ser chamado antes de btree_init
+ */
+void btree_set_wal_group(int group_size) {
+    btree_wal_group = (group_size < 0) ? 0 : group_size;
+}
+
+/**
+ * Abre o índice mapeado em memória, somente para leitura (antes de btree_init)
+ * Buscas e percursos usam as páginas direto do mapeamento; alterações são
+ * recusadas e devem ser feitas abrindo o índice no modo normal (pool)
+ */
+void btree_set_mmap(int enabled) {
+    btree_use_mmap = enabled;
+}
+
+/**
+ * Configura o filtro de Bloom (antes de btree_init): taxa de falsos positivos
+ * desejada (0 = sem filtro) e limite de memória em bytes (0 = sem limite)
+ */
+void btree_set_bloom(double fp_rate, long max_bytes) {
+    btree_bloom_fp = (fp_rate > 0.0 && fp_rate < 1.0) ? fp_rate : 0.0;
+    btree_bloom_max_bytes = (max_bytes > 0) ? max_bytes : 0;
+}
+
+/**
+ * Indica se o índice foi aberto somente para leitura
+ */
+int btree_is_read_only() {
+    return btree_read_only;
+}
 
 /**
  * Inicializa a Árvore-B (raiz virtualizada em RAM)
+ * O arquivo fica aberto e as páginas passam pelo pool de buffers
  */
 void btree_init() {
-    FILE* file = fopen("btree.dat", "rb");
+    BTreeKey* legacy_keys = NULL;
+    int legacy_count = 0;
+    
+    // Dicionário antes da conversão: as chaves convertidas recebem ids nele
+    if (!names_open(BTREE_NAMES_FILE)) {
+        exit(1);
+    }
+    
+    // Arquivo em formato antigo: guarda as chaves e recria no formato atual
+    int legacy_version = btree_read_legacy("btree.dat", &legacy_keys, &legacy_count);
+    if (legacy_version) {
+        char backup[32];
+        sprintf(backup, "btree.dat.v%d", legacy_version);
+        remove(backup);
+        if (rename("btree.dat", backup) != 0) {
+            fprintf(stderr, "Erro: Não foi possível preservar o btree.dat antigo\n");
+            free(legacy_keys);
+            exit(1);
+        }
+        printf("Convertendo btree.dat da versão %d (%d chaves); original salvo em %s\n",
+               legacy_version, legacy_count, backup);
+    }
+    
+    if (!pager_open("btree.dat", BTREE_PAGE_SIZE, BTREE_POOL_FRAMES)) {
+        exit(1);
+    }
+    
+    int recovered = 0;
+    if (btree_wal_group > 0) {
+        if (!wal_open(BTREE_WAL_FILE, btree_wal_group)) exit(1);
+        
+        // Reaplica no arquivo as operações confirmadas desde o último checkpoint
+        // (log sem btree.dat é de outro índice e é descartado)
+        if (!pager_is_new_file()) {
+            recovered = wal_recover(btree_apply_log);
+            if (recovered > 0) {
+                pager_sync();
+                printf("Log recuperado: %d operações reaplicadas no btree.dat\n", recovered);
+            }
+        }
+        wal_reset();
+        
+        pager_set_wal_hook(wal_force);
+        btree_wal_enabled = 1;
+    }
+    
+    if (!pager_is_new_file()) {
+        if (!pager_read_raw(0, &btree_header, sizeof(BTreeHeader)) ||
+            memcmp(btree_header.magic, BTREE_MAGIC, sizeof(btree_header.magic)) != 0 ||
+            btree_header.version != BTREE_VERSION ||
+            btree_header.page_size != BTREE_PAGE_SIZE ||
+            btree_header.order < BTREE_MIN_ORDER || btree_header.order > BTREE_MAX_ORDER) {
+            fprintf(stderr, "Erro: btree.dat incompatível (versão %d, página %d, ordem %d)\n",
+                    btree_header.version, btree_header.page_size, btree_header.order);
+            exit(1);
+        }
+        if ((unsigned int)btree_header.name_count > names_count()) {
+            fprintf(stderr, "Erro: %s tem %u nomes, mas o índice usa %d\n",
+                    BTREE_NAMES_FILE, names_count(), btree_header.name_count);
+            exit(1);
+        }
+        btree_set_limits(btree_header.order);
+        btree_set_root(btree_header.root_offset);
+        
+        // Queda no meio da compactação do arquivo de dados: termina a troca
+        if (btree_header.data_moving) {
+            printf("Concluindo a compactação interrompida de %s\n", BTREE_DATA_FILE);
+            btree_relocate_finish();
+        }
+    } else {
+        btree_set_limits(btree_requested_order);
+        btree_format_header();
+        btree_set_root(btree_create_node(1));
+        btree_update_header();
+        btree_flush_locked();
+    }
+    
+    if (legacy_keys) {
+        btree_rebuild(legacy_keys, legacy_count, BTREE_DEFAULT_FILL);
+        free(legacy_keys);
+    }
+    
+    // Filtro gravado só vale se corresponde ao último checkpoint do índice
+    if (btree_bloom_fp > 0.0) {
+        if (!btree_bloom) btree_bloom_load(recovered);
+    } else {
+        remove(BTREE_BLOOM_FILE);
+    }
+    
+    // Modo mapeado: tudo já recuperado e gravado (checkpoint) antes de mapear
+    if (btree_use_mmap) {
+        btree_flush_locked();
+        if (pager_map()) {
+            btree_read_only = 1;
+            btree_set_root(btree_header.root_offset);
+            btree_header_dirty = 0;
+        } else {
+            fprintf(stderr, "Aviso: Não foi possível mapear btree.dat; usando o pool de buffers\n");
+        }
+    }
+}
+
+/**
+ * Preenche o cabeçalho de um arquivo vazio com a ordem atual
+ * Página 0 é do cabeçalho; os nós começam na página 1
+ */
+static void btree_format_header() {
+    memset(&btree_header, 0, sizeof(BTreeHeader));
+    memcpy(btree_header.magic, BTREE_MAGIC, sizeof(btree_header.magic));
+    btree_header.version = BTREE_VERSION;
+    btree_header.page_size = BTREE_PAGE_SIZE;
+    btree_header.order = btree_order;
+    btree_header.free_offset = BTREE_PAGE_SIZE;
+    btree_header.node_count = 0;
+    btree_header.root_offset = -1;
+    btree_header_dirty = 1;
+}
+
+/**
+ * Calcula limites de chaves por nó a partir da ordem
+ * A divisão é preventiva (na descida), por isso a ordem precisa ser par
+ */
+static void btree_set_limits(int order) {
+    if (order <= 0 || order > BTREE_MAX_ORDER) order = BTREE_MAX_ORDER;
+    if (order < BTREE_MIN_ORDER) order = BTREE_MIN_ORDER;
+    if (order % 2 != 0) order--;
+    
+    btree_order = order;
+    btree_max_keys = order - 1;
+    btree_min_keys = order / 2 - 1;
+}
+
+/**
+ * Lê as chaves de um btree.dat no formato original (versão 1: sem
+ * cabeçalho, ordem 3). Retorna 1 se converteu ou 0 se o arquivo não existe
+ * ou já está no formato atual
+ */
+static int btree_read_legacy(const char* filename, BTreeKey** keys, int* count) {
+    FILE* file = fopen(filename, "rb");
+    if (!file) return 0;
+    
+    BTreeHeader header;
+    memset(&header, 0, sizeof(BTreeHeader));
+    size_t header_read = fread(&header, 1, sizeof(BTreeHeader), file);
+    if (header_read >= sizeof(header.magic) && memcmp(header.magic, BTREE_MAGIC, sizeof(header.magic)) == 0) {
+        fclose(file);
+        if (header.version == BTREE_VERSION) return 0;
+        fprintf(stderr, "Erro: btree.dat com versão desconhecida (%d)\n", header.version);
+        exit(1);
+    }
+    
+    fseek(file, 0, SEEK_END);
+    long file_size = ftell(file);
+    
+    *keys = NULL;
+    *count = 0;
+    int capacity = 0;
+    
+    LegacyBTreeHeader legacy_header;
+    fseek(file, 0, SEEK_SET);
+    if (fread(&legacy_header, sizeof(LegacyBTreeHeader), 1, file) == 1) {
+        btree_collect_legacy(file, file_size, legacy_header.root_offset, 0, keys, count, &capacity);
+    }
+    fclose(file);
+    return 1;
+}
+
+/**
+ * Percorre recursivamente a árvore da versão 1 coletando as chaves
+ */
+static void btree_collect_legacy(FILE* file, long file_size, long offset, int depth,
+                                 BTreeKey** keys, int* count, int* capacity) {
+    // Protege contra offsets inválidos ou ciclos em arquivos corrompidos
+    if (offset < 0 || offset + (long)sizeof(LegacyBTreeNode) > file_size || depth > 64) return;
+    
+    LegacyBTreeNode node;
+    fseek(file, offset, SEEK_SET);
+    if (fread(&node, sizeof(LegacyBTreeNode), 1, file) != 1) return;
+    if (node.num_keys < 0 || node.num_keys > LEGACY_ORDER - 1) return;
+    
+    for (int i = 0; i < node.num_keys; i++) {
+        if (!btree_append_legacy(keys, count, capacity, &node.keys[i])) return;
+    }
+    
+    if (!node.is_leaf) {
+        for (int i = 0; i <= node.num_keys; i++) {
+            btree_collect_legacy(file, file_size, node.children[i], depth + 1, keys, count, capacity);
+        }
+    }
+}
+
+/**
+ * Acrescenta chave no vetor dinâmico da conversão
+ */
+static int btree_append_key(BTreeKey** keys, int* count, int* capacity, const BTreeKey* key) {
+    if (*count == *capacity) {
+        int new_capacity = *capacity ? *capacity * 2 : 64;
+        BTreeKey* temp = realloc(*keys, new_capacity * sizeof(BTreeKey));
+        if (!temp) return 0;
+        *keys = temp;
+        *capacity = new_capacity;
+    }
+    
+    (*keys)[(*count)++] = *key;
+    return 1;
+}
+
+/**
+ * Acrescenta chave da versão 1 (nome de tamanho fixo) na conversão
+ */
+static int btree_append_legacy(BTreeKey** keys, int* count, int* capacity, const LegacyBTreeKey* key) {
+    BTreeKey copy;
+    memset(&copy, 0, sizeof(BTreeKey));
+    memcpy(copy.name, key->name, LEGACY_NAME_LEN);
+    copy.name[LEGACY_NAME_LEN - 1] = '\0';
+    copy.threshold = key->threshold;
+    copy.data_offset = key->data_offset;
+    copy.data_size = key->data_size;
+    copy.width = key->width;
+    copy.height = key->height;
+    return btree_append_key(keys, count, capacity, &copy);
+}
+
+/**
+ * Grava no disco o cabeçalho e as páginas modificadas (checkpoint)
+ */
+void btree_flush() {
+    pthread_rwlock_rdlock(&btree_tree_latch);
+    pthread_mutex_lock(&btree_write_mutex);
+    btree_flush_locked();
+    pthread_mutex_unlock(&btree_write_mutex);
+    pthread_rwlock_unlock(&btree_tree_latch);
+}
+
+/**
+ * Checkpoint sem travas (chamador é o escritor ou o único usuário)
+ */
+static void btree_flush_locked() {
+    if (btree_read_only) return;
+    
+    btree_commit();
+    btree_checkpoint();
+}
+
+/**
+ * Torna duráveis as operações já confirmadas (fsync do log, sem checkpoint)
+ */
+void btree_sync() {
+    if (btree_wal_enabled) {
+        wal_sync();
+    } else {
+        btree_flush();
+    }
+}
+
+/**
+ * Finaliza a Árvore-B: grava pendências e fecha o arquivo
+ */
+void btree_close() {
+    pthread_rwlock_wrlock(&btree_tree_latch);
+    btree_flush_locked();
+    if (btree_root) {
+        pager_unpin(btree_root, 0);
+        btree_root = NULL;
+    }
+    pager_close();
+    
+    if (btree_wal_enabled) {
+        pager_set_wal_hook(NULL);
+        wal_close();
+        btree_wal_enabled = 0;
+    }
+    free(btree_txn_pages);
+    btree_txn_pages = NULL;
+    bloom_free(btree_bloom);
+    btree_bloom = NULL;
+    btree_bloom_stale = 0;
+    btree_bloom_free_retired();
+    names_close();
+    btree_txn_capacity = 0;
+    btree_read_only = 0;
+    btree_rightmost_leaf = -1;
+    btree_last_append = 0;
+    pthread_rwlock_unlock(&btree_tree_latch);
+}
+
+/**
+ * Recusa alterações quando o índice foi aberto mapeado (somente leitura)
+ */
+static int btree_check_writable() {
+    if (!btree_read_only) return 1;
+    
+    fprintf(stderr, "Erro: Índice aberto em modo somente leitura (mmap)\n");
+    return 0;
+}
+
+/**
+ * Troca o filtro por um vazio dimensionado para capacity chaves
+ * (chamador tem a árvore só para si)
+ */
+static void btree_bloom_reset(long capacity) {
+    BloomFilter* filter = bloom_create(capacity, btree_bloom_fp, btree_bloom_max_bytes);
+    if (!filter) {
+        fprintf(stderr, "Erro: Falha na alocação do filtro de Bloom\n");
+        exit(1);
+    }
+    
+    bloom_free(btree_bloom);
+    btree_bloom_free_retired();
+    btree_bloom = filter;
+    btree_bloom_dirty = 1;
+    btree_bloom_stale = 0;
+}
+
+/**
+ * Lê o filtro gravado; recria a partir das folhas se ele não existe, é de
+ * outro checkpoint, foi gravado com outra taxa ou o log trouxe operações
+ */
+static void btree_bloom_load(int recovered) {
+    BloomFilter* filter = bloom_load(BTREE_BLOOM_FILE);
+    
+    if (filter && !recovered && filter->stamp == btree_header.bloom_stamp &&
+        filter->fp_rate == btree_bloom_fp) {
+        btree_bloom = filter;
+        btree_bloom_dirty = 0;
+        if (filter->added > filter->capacity || filter->removed > filter->capacity / 2) {
+            btree_bloom_rebuild();
+        }
+        return;
+    }
+    
+    bloom_free(filter);
+    btree_bloom_rebuild();
+}
+
+/**
+ * Recria o filtro percorrendo as folhas, sem parar os leitores (chamador é
+ * o escritor ou o único usuário); capacidade com folga para o índice dobrar
+ */
+static void btree_bloom_rebuild() {
+    BTreeCursor cursor;
+    BTreeKey key;
+    long count = 0;
+    
+    btree_cursor_start(&cursor, 0, INT_MIN);
+    while (btree_cursor_next(&cursor, &key)) count++;
+    
+    // Reconstrução por remoções mantém o tamanho: o filtro é reescrito no lugar
+    long capacity = 2 * count;
+    if (btree_bloom && capacity <= btree_bloom->capacity) capacity = btree_bloom->capacity;
+    
+    BloomFilter* filter = bloom_create(capacity, btree_bloom_fp, btree_bloom_max_bytes);
+    if (!filter) {
+        fprintf(stderr, "Erro: Falha na alocação do filtro de Bloom\n");
+        exit(1);
+    }
+    
+    btree_cursor_start(&cursor, 0, INT_MIN);
+    while (btree_cursor_next(&cursor, &key)) {
+        bloom_add(filter, btree_key_of(&key));
+    }
+    
+    btree_bloom_install(filter);
+    btree_bloom_dirty = 1;
+    btree_bloom_stale = 0;
+}
+
+/**
+ * Publica o filtro novo para os leitores
+ * Mesma geometria: copia palavra a palavra (toda chave presente está nos
+ * dois filtros, então nenhuma mistura das duas versões a recusa); senão
+ * troca o ponteiro e guarda o antigo até ninguém mais poder lê-lo
+ */
+static void btree_bloom_install(BloomFilter* filter) {
+    BloomFilter* old = btree_bloom;
+    if (old) {
+        filter->queries = old->queries;
+        filter->rejected = old->rejected;
+        filter->false_positives = old->false_positives;
+    }
+    
+    if (old && old->bit_count == filter->bit_count && old->hash_count == filter->hash_count) {
+        for (long i = 0; i < filter->bit_count / 64; i++) {
+            __atomic_store_n(&old->bits[i], filter->bits[i], __ATOMIC_RELAXED);
+        }
+        old->capacity = filter->capacity;
+        old->added = filter->added;
+        old->removed = 0;
+        bloom_free(filter);
+        return;
+    }
+    
+    if (old) {
+        BloomFilter** temp = realloc(btree_bloom_retired,
+                                     (btree_bloom_retired_count + 1) * sizeof(BloomFilter*));
+        if (!temp) {
+            fprintf(stderr, "Erro: Falha na alocação do filtro de Bloom\n");
+            exit(1);
+        }
+        btree_bloom_retired = temp;
+        btree_bloom_retired[btree_bloom_retired_count++] = old;
+    }
+    __atomic_store_n(&btree_bloom, filter, __ATOMIC_RELEASE);
+}
+
+/**
+ * Libera os filtros substituídos (chamador tem a árvore só para si)
+ */
+static void btree_bloom_free_retired() {
+    for (int i = 0; i < btree_bloom_retired_count; i++) {
+        bloom_free(btree_bloom_retired[i]);
+    }
+    free(btree_bloom_retired);
+    btree_bloom_retired = NULL;
+    btree_bloom_retired_count = 0;
+}
+
+/**
+ * Reconstrói o filtro que encheu ou acumulou remoções, fora da operação que
+ * percebeu; só os escritores esperam, os leitores seguem com o filtro atual
+ */
+static void btree_bloom_refresh() {
+    pthread_rwlock_rdlock(&btree_tree_latch);
+    pthread_mutex_lock(&btree_write_mutex);
+    if (btree_bloom_stale) btree_bloom_rebuild();
+    pthread_mutex_unlock(&btree_write_mutex);
+    pthread_rwlock_unlock(&btree_tree_latch);
+}
+
+/**
+ * Grava o filtro alterado no checkpoint, antes do cabeçalho: o carimbo só
+ * coincide se os dois foram gravados (queda no meio força reconstrução)
+ */
+static void btree_bloom_save() {
+    if (!btree_bloom || !btree_bloom_dirty || btree_read_only) return;
+    
+    btree_header.bloom_stamp++;
+    btree_bloom->stamp = btree_header.bloom_stamp;
+    if (bloom_save(btree_bloom, BTREE_BLOOM_FILE)) btree_bloom_dirty = 0;
+}
+
+/**
+ * Marca o filtro como alterado desde o checkpoint
+ * Sem log, a queda não seria detectada na abertura: o arquivo gravado deixa
+ * de valer já na primeira alteração
+ */
+static void btree_bloom_touch() {
+    if (!btree_bloom_dirty && !btree_wal_enabled) remove(BTREE_BLOOM_FILE);
+    btree_bloom_dirty = 1;
+}
+
+/**
+ * Mantém a página fixada no conjunto de escrita da operação atual
+ */
+static void btree_track_page(BTreeNode* node) {
+    if (!btree_wal_enabled) return;
+    
+    for (int i = 0; i < btree_txn_count; i++) {
+        if (btree_txn_pages[i] == node) return;
+    }
+    
+    if (btree_txn_count == btree_txn_capacity) {
+        int capacity = btree_txn_capacity ? btree_txn_capacity * 2 : 16;
+        BTreeNode** temp = realloc(btree_txn_pages, capacity * sizeof(BTreeNode*));
+        if (!temp) {
+            fprintf(stderr, "Erro: Falha na alocação do conjunto de escrita\n");
+            exit(1);
+        }
+        btree_txn_pages = temp;
+        btree_txn_capacity = capacity;
+    }
+    
+    // Segunda fixação: a página não pode ser despejada antes do commit
+    BTreeNode* page = pager_pin(node->self_offset);
+    if (!page) exit(1);
+    btree_txn_pages[btree_txn_count++] = page;
+}
+
+/**
+ * Confirma a operação: grava no log a imagem de cada página modificada e
+ * o cabeçalho como registro de commit; o fsync fica com o commit em grupo
+ */
+static void btree_commit() {
+    if (!btree_wal_enabled || (btree_txn_count == 0 && !btree_header_dirty)) return;
+    
+    for (int i = 0; i < btree_txn_count; i++) {
+        wal_append_page(btree_txn_pages[i]->self_offset, btree_txn_pages[i], BTREE_PAGE_SIZE);
+    }
+    
+    // Nomes novos chegam ao disco antes do commit das chaves que os usam
+    btree_header.name_count = (int)names_count();
+    names_sync();
+    long lsn = wal_commit(&btree_header, sizeof(BTreeHeader));
+    
+    // A página só pode ir para o btree.dat depois que o commit estiver no disco
+    for (int i = 0; i < btree_txn_count; i++) {
+        pager_set_page_lsn(btree_txn_pages[i], lsn);
+        pager_unpin(btree_txn_pages[i], 1);
+    }
+    btree_txn_count = 0;
+    
+    if (wal_size() > WAL_CHECKPOINT_BYTES) {
+        btree_checkpoint();
+    }
+}
+
+/**
+ * Leva as páginas do pool e o cabeçalho ao btree.dat e esvazia o log
+ */
+static void btree_checkpoint() {
+    if (btree_wal_enabled) wal_sync();
+    
+    btree_header.name_count = (int)names_count();
+    names_sync();
+    pager_flush();
+    btree_bloom_save();
+    pager_write_raw(0, &btree_header, sizeof(BTreeHeader));
+    btree_header_dirty = 0;
+    
+    if (btree_wal_enabled) {
+        pager_sync();
+        wal_reset();
+    }
+}
+
+/**
+ * Grava no btree.dat uma página (ou o cabeçalho) lida do log na recuperação
+ */
+static void btree_apply_log(long offset, const void* data, int size) {
+    if (!pager_write_raw(offset, data, size)) {
+        fprintf(stderr, "Erro: Falha ao reaplicar o log no offset %ld\n", offset);
+        exit(1);
+    }
+}
+
+/**
+ * Cria novo nó no arquivo
+ * Reaproveita a primeira página da lista de livres antes de crescer o arquivo
+ */
+static long btree_create_node(int is_leaf) {
+    long offset;
+    
+    if (btree_header.free_list_head != 0) {
+        offset = btree_header.free_list_head;
+        BTreeNode* free_page = btree_lock_node(offset);
+        btree_header.free_list_head = free_page->next_leaf;
+        btree_release_node(free_page);
+        btree_header.free_count--;
+    } else {
+        offset = btree_header.free_offset;
+        btree_header.free_offset += BTREE_PAGE_SIZE;
+    }
+    btree_header.node_count++;
+    btree_header_dirty = 1;
+    
+    // Página nova: nada a ler do disco, só fixar no pool. Reaproveitada, ela
+    // pode ter leitores otimistas com ponteiro antigo: só é zerada com a
+    // trava exclusiva (versão ímpar), nunca sem ela
+    BTreeNode* page = pager_pin_new(offset);
+    if (!page) exit(1);
+    pager_latch(page, 1);
+    memset(page, 0, sizeof(BTreeNode));
+    page->is_leaf = is_leaf;
+    page->self_offset = offset;
+    page->next_leaf = -1;
+    page->first_child = -1;
+    page->heap_start = BTREE_NODE_SPACE;
+    btree_track_page(page);
+    pager_unlatch(page);
+    pager_unpin(page, 1);
+    
+    return offset;
+}
+
+/**
+ * Devolve página descartada (fusão ou raiz removida) à lista de livres
+ * Recebe o nó travado e o libera
+ */
+static void btree_free_node(BTreeNode* node) {
+    long offset = node->self_offset;
+    
+    node->is_leaf = BTREE_PAGE_FREE;
+    node->num_keys = 0;
+    node->next_leaf = btree_header.free_list_head;
+    btree_write_node(offset, node);
+    btree_release_node(node);
+    
+    btree_header.free_list_head = offset;
+    btree_header.free_count++;
+    btree_header.node_count--;
+    btree_header_dirty = 1;
+}
+
+/**
+ * Lê nó do arquivo (fixa a página no pool e trava para leitura)
+ * Todo nó lido deve ser devolvido com btree_release_node
+ */
+BTreeNode* btree_read_node(long offset) {
+    if (offset == -1) return NULL;
+    
+    BTreeNode* node = pager_pin(offset);
+    if (!node) {
+        fprintf(stderr, "Erro: Falha ao ler página no offset %ld\n", offset);
+        exit(1);
+    }
+    pager_latch(node, 0);
+    return node;
+}
+
+/**
+ * Lê nó para alteração (fixa e trava exclusivamente; só o escritor usa)
+ */
+static BTreeNode* btree_lock_node(long offset) {
+    if (offset == -1) return NULL;
+    
+    BTreeNode* node = pager_pin(offset);
+    if (!node) {
+        fprintf(stderr, "Erro: Falha ao ler página no offset %ld\n", offset);
+        exit(1);
+    }
+    pager_latch(node, 1);
+    node->self_offset = offset;
+    return node;
+}
+
+/**
+ * Escreve nó no arquivo (a página fica suja no pool até ser despejada)
+ */
+void btree_write_node(long offset, BTreeNode* node) {
+    (void)offset;
+    pager_mark_dirty(node);
+    btree_track_page(node);
+}
+
+/**
+ * Libera a trava e a página do nó no pool de buffers
+ */
+void btree_release_node(BTreeNode* node) {
+    if (!node) return;
+    
+    pager_unlatch(node);
+    pager_unpin(node, 0);
+}
+
+/**
+ * Atualiza cabeçalho do arquivo (gravado junto com as páginas)
+ */
+static void btree_update_header() {
+    btree_header_dirty = 1;
+}
+
+/**
+ * Troca a raiz (chamador segura btree_root_latch para escrita ou é o único
+ * usuário) e mantém a página da nova raiz sempre no pool
+ */
+static void btree_set_root(long offset) {
+    if (btree_root) pager_unpin(btree_root, 0);
+    
+    __atomic_store_n(&btree_header.root_offset, offset, __ATOMIC_RELEASE);
+    btree_root = pager_pin(offset);
+    if (!btree_root) {
+        fprintf(stderr, "Erro: Falha ao ler a raiz no offset %ld\n", offset);
+        exit(1);
+    }
+    btree_header_dirty = 1;
+}
+
+/**
+ * Compara chaves (id do nome + limiar)
+ */
+static int btree_compare_keys(const BTreeKey* a, const BTreeKey* b) {
+    unsigned long long x = btree_key_of(a);
+    unsigned long long y = btree_key_of(b);
+    return (x > y) - (x < y);
+}
+
+/**
+ * Chave de 64 bits: id do nome em cima e limiar com o bit de sinal invertido
+ * embaixo, então a ordem dos inteiros sem sinal é a de (id, limiar)
+ */
+static unsigned long long btree_key_value(unsigned int name_id, int threshold) {
+    return ((unsigned long long)name_id << 32) | ((unsigned int)threshold ^ 0x80000000u);
+}
+
+/**
+ * Chave de 64 bits de uma BTreeKey (name_id já preenchido)
+ */
+static unsigned long long btree_key_of(const BTreeKey* key) {
+    return btree_key_value(key->name_id, key->threshold);
+}
+
+/**
+ * Limiar guardado na chave de 64 bits
+ */
+static int btree_key_threshold(unsigned long long value) {
+    return (int)((unsigned int)value ^ 0x80000000u);
+}
+
+/**
+ * Preenche o id do nome da chave, cadastrando o nome se ainda não existe
+ * Retorna 0 se o nome não pode entrar no dicionário
+ */
+static int btree_intern_key(BTreeKey* key) {
+    key->name_id = names_intern(key->name);
+    if (key->name_id != NAMES_NONE) return 1;
+    
+    fprintf(stderr, "Erro: Nome inválido para o índice: \"%s\"\n", key->name);
+    return 0;
+}
+
+/**
+ * Vetor de slots no início da área de dados da página
+ */
+static BTreeSlot* btree_slots(const BTreeNode* node) {
+    return (BTreeSlot*)node->data;
+}
+
+/**
+ * Bytes do registro: dados da imagem (folha) ou filho (interno)
+ */
+static int btree_value_size(const BTreeNode* node) {
+    return node->is_leaf ? BTREE_LEAF_VALUE : (int)sizeof(long);
+}
+
+/**
+ * Registro da chave index
+ */
+static unsigned char* btree_node_record(const BTreeNode* node, int index) {
+    return (unsigned char*)node->data + btree_slots(node)[index].offset;
+}
+
+/**
+ * Monta a chave i do nó (nome tirado do dicionário); dados só nas folhas
+ */
+void btree_node_key(const BTreeNode* node, int index, BTreeKey* key) {
+    const BTreeSlot* slot = &btree_slots(node)[index];
+    unsigned long long value = slot->key;
+    
+    key->name_id = (unsigned int)(value >> 32);
+    key->threshold = btree_key_threshold(value);
+    key->data_offset = 0;
+    key->data_size = 0;
+    key->width = 0;
+    key->height = 0;
+    
+    // Leitura otimista pode ver a página no meio de uma alteração
+    const char* name = names_get(key->name_id);
+    strcpy(key->name, name ? name : "");
+    
+    if (node->is_leaf && slot->offset + BTREE_LEAF_VALUE <= BTREE_NODE_SPACE) {
+        const unsigned char* record = node->data + slot->offset;
+        memcpy(&key->data_offset, record, sizeof(long));
+        record += sizeof(long);
+        memcpy(&key->data_size, record, sizeof(int));
+        memcpy(&key->width, record + sizeof(int), sizeof(int));
+        memcpy(&key->height, record + 2 * sizeof(int), sizeof(int));
+    }
+}
+
+/**
+ * Filho i de um nó interno (o primeiro fica no cabeçalho da página)
+ */
+long btree_node_child(const BTreeNode* node, int index) {
+    if (index == 0) return node->first_child;
+    
+    const BTreeSlot* slot = &btree_slots(node)[index - 1];
+    if (slot->offset + sizeof(long) > BTREE_NODE_SPACE) return -1;
+    
+    long child;
+    memcpy(&child, node->data + slot->offset, sizeof(long));
+    return child;
+}
+
+/**
+ * Grava os dados da imagem no registro de uma folha
+ */
+static void btree_store_value(unsigned char* record, const BTreeKey* key) {
+    memcpy(record, &key->data_offset, sizeof(long));
+    record += sizeof(long);
+    memcpy(record, &key->data_size, sizeof(int));
+    memcpy(record + sizeof(int), &key->width, sizeof(int));
+    memcpy(record + 2 * sizeof(int), &key->height, sizeof(int));
+}
+
+/**
+ * Aloca o registro no espaço contíguo livre e preenche o slot
+ * record: dados da imagem (folha) ou o filho à direita da chave (interno)
+ */
+static void btree_node_store(BTreeNode* node, unsigned long long key, const void* record, BTreeSlot* slot) {
+    int size = btree_value_size(node);
+    
+    node->heap_start -= size;
+    memcpy(node->data + node->heap_start, record, size);
+    slot->key = key;
+    slot->offset = node->heap_start;
+}
+
+/**
+ * Bytes livres do nó (contíguos + registros removidos)
+ */
+static int btree_node_free_space(const BTreeNode* node) {
+    return node->heap_start - node->num_keys * (int)sizeof(BTreeSlot) + node->garbage;
+}
+
+/**
+ * Nó cheio: atingiu a ordem (a ordem máxima já garante que as chaves cabem)
+ */
+static int btree_node_full(const BTreeNode* node) {
+    return node->num_keys >= btree_max_keys;
+}
+
+/**
+ * Nó no mínimo: uma remoção abaixo dele poderia deixá-lo vazio demais
+ */
+static int btree_node_minimal(const BTreeNode* node) {
+    return node->num_keys <= btree_min_keys;
+}
+
+/**
+ * Irmão pode emprestar uma chave sem ficar abaixo do mínimo
+ */
+static int btree_node_can_lend(const BTreeNode* node) {
+    return node->num_keys > btree_min_keys;
+}
+
+/**
+ * Insere a chave na posição index (interno: o registro é o filho index + 1)
+ * O chamador garante que o nó não está cheio
+ */
+static void btree_node_insert(BTreeNode* node, int index, unsigned long long key, const void* record) {
+    int size = (int)sizeof(BTreeSlot) + btree_value_size(node);
+    if (node->heap_start - node->num_keys * (int)sizeof(BTreeSlot) < size) {
+        btree_node_compact(node);
+    }
+    
+    BTreeSlot* slots = btree_slots(node);
+    memmove(&slots[index + 1], &slots[index], (node->num_keys - index) * sizeof(BTreeSlot));
+    btree_node_store(node, key, record, &slots[index]);
+    node->num_keys++;
+}
+
+/**
+ * Acrescenta no fim do nó as chaves [from, from + count) de source, com os
+ * registros (nós do mesmo tipo)
+ */
+static void btree_node_append(BTreeNode* node, const BTreeNode* source, int from, int count) {
+    int size = (int)sizeof(BTreeSlot) + btree_value_size(node);
+    if (node->heap_start - node->num_keys * (int)sizeof(BTreeSlot) < count * size) {
+        btree_node_compact(node);
+    }
+    
+    BTreeSlot* slots = btree_slots(node);
+    const BTreeSlot* source_slots = btree_slots(source);
+    for (int i = from; i < from + count; i++) {
+        btree_node_store(node, source_slots[i].key, btree_node_record(source, i), &slots[node->num_keys++]);
+    }
+}
+
+/**
+ * Remove a chave index (interno: junto com o filho index + 1)
+ * O registro só vira espaço livre na próxima compactação da página
+ */
+static void btree_node_remove(BTreeNode* node, int index) {
+    BTreeSlot* slots = btree_slots(node);
+    node->garbage += btree_value_size(node);
+    memmove(&slots[index], &slots[index + 1], (node->num_keys - index - 1) * sizeof(BTreeSlot));
+    node->num_keys--;
+}
+
+/**
+ * Descarta as chaves a partir de count (interno: com os filhos à direita)
+ */
+static void btree_node_truncate(BTreeNode* node, int count) {
+    node->garbage += (node->num_keys - count) * btree_value_size(node);
+    node->num_keys = count;
+}
+
+/**
+ * Junta os registros no fim da página, recuperando os removidos
+ */
+static void btree_node_compact(BTreeNode* node) {
+    unsigned char buffer[BTREE_NODE_SPACE];
+    memcpy(buffer, node->data, BTREE_NODE_SPACE);
+    
+    BTreeSlot* slots = btree_slots(node);
+    int size = btree_value_size(node);
+    int heap = BTREE_NODE_SPACE;
+    for (int i = 0; i < node->num_keys; i++) {
+        heap -= size;
+        memcpy(node->data + heap, buffer + slots[i].offset, size);
+        slots[i].offset = heap;
+    }
+    node->heap_start = heap;
+    node->garbage = 0;
+}
+
+/**
+ * Adaptador de btree_compare_keys para qsort
+ */
+static int btree_compare_key_ptrs(const void* a, const void* b) {
+    return btree_compare_keys(a, b);
+}
+
+/**
+ * Insere chave na Árvore-B
+ */
+void btree_insert(BTreeKey key) {
+    if (!btree_check_writable() || !btree_intern_key(&key)) return;
+    
+    pthread_rwlock_rdlock(&btree_tree_latch);
+    pthread_mutex_lock(&btree_write_mutex);
+    
+    // Filtro antes da folha: quem já enxerga a chave na árvore nunca
+    // recebe "ausente" do filtro
+    btree_bloom_add_keys(&key, 1);
+    
+    BTreeNode* leaf = btree_insert_find_leaf(btree_key_of(&key), NULL, NULL);
+    btree_insert_into_leaf(leaf, &key, 1);
+    btree_release_node(leaf);
+    
+    btree_update_header();
+    btree_commit();
+    int refresh = btree_bloom_stale;
+    pthread_mutex_unlock(&btree_write_mutex);
+    pthread_rwlock_unlock(&btree_tree_latch);
+    
+    if (refresh) btree_bloom_refresh();
+}
+
+/**
+ * Insere várias chaves de uma vez (ex.: as versões de uma mesma imagem)
+ * As chaves são ordenadas se preciso (o vetor é alterado); cada descida
+ * leva à folha todas as chaves seguintes que pertencem a ela e cabem nela,
+ * então a folha é lida, intercalada e gravada uma vez por grupo
+ * Chaves com nome inválido são descartadas. Retorna o número de chaves inseridas
+ */
+int btree_insert_batch(BTreeKey* keys, int count) {
+    if (count <= 0 || !btree_check_writable()) return 0;
+    
+    int valid = 0;
+    for (int i = 0; i < count; i++) {
+        if (btree_intern_key(&keys[i])) keys[valid++] = keys[i];
+    }
+    count = valid;
+    if (count == 0) return 0;
+    
+    int sorted = 1;
+    for (int i = 1; i < count && sorted; i++) {
+        if (btree_compare_keys(&keys[i - 1], &keys[i]) > 0) sorted = 0;
+    }
+    if (!sorted) {
+        qsort(keys, count, sizeof(BTreeKey), btree_compare_key_ptrs);
+    }
+    
+    pthread_rwlock_rdlock(&btree_tree_latch);
+    pthread_mutex_lock(&btree_write_mutex);
+    
+    btree_bloom_add_keys(keys, count);
+    
+    int pos = 0;
+    while (pos < count) {
+        unsigned long long bound = 0;
+        int has_bound = 0;
+        BTreeNode* leaf = btree_insert_find_leaf(btree_key_of(&keys[pos]), &bound, &has_bound);
+        
+        // A descida divide folhas cheias: sempre cabe ao menos a primeira
+        int n = 1;
+        while (pos + n < count && leaf->num_keys + n < btree_max_keys &&
+               (!has_bound || btree_key_of(&keys[pos + n]) < bound)) {
+            n++;
+        }
+        
+        btree_insert_into_leaf(leaf, &keys[pos], n);
+        btree_release_node(leaf);
+        pos += n;
+        
+        // Lote grande não pode prender no conjunto de escrita o pool inteiro
+        if (btree_txn_count > BTREE_POOL_FRAMES / 4) {
+            btree_update_header();
+            btree_commit();
+        }
+    }
+    
+    btree_update_header();
+    btree_commit();
+    int refresh = btree_bloom_stale;
+    pthread_mutex_unlock(&btree_write_mutex);
+    pthread_rwlock_unlock(&btree_tree_latch);
+    
+    if (refresh) btree_bloom_refresh();
+    return count;
+}
+
+/**
+ * Registra no filtro as chaves que vão ser inseridas (escritor)
+ */
+static void btree_bloom_add_keys(const BTreeKey* keys, int count) {
+    if (!btree_bloom) return;
+    
+    btree_bloom_touch();
+    for (int i = 0; i < count; i++) {
+        bloom_add(btree_bloom, btree_key_of(&keys[i]));
+    }
+    if (btree_bloom->added > btree_bloom->capacity) btree_bloom_stale = 1;
+}
+
+/**
+ * Folha (travada e com espaço) onde a chave deve entrar
+ * Chave depois da última da folha mais à direita: vai direto para ela, sem
+ * passar pela raiz; senão desce normalmente
+ */
+static BTreeNode* btree_insert_find_leaf(unsigned long long key, unsigned long long* bound, int* has_bound) {
+    if (btree_rightmost_leaf != -1) {
+        BTreeNode* leaf = btree_lock_node(btree_rightmost_leaf);
+        
+        // Só o escritor altera a árvore: se a página ainda é a última folha,
+        // nada acima dela pode mudar até o commit
+        if (leaf->is_leaf == 1 && leaf->next_leaf == -1 &&
+            !btree_node_full(leaf) && btree_is_append(leaf, key)) {
+            return leaf;
+        }
+        btree_release_node(leaf);
+        btree_rightmost_leaf = -1;
+    }
+    
+    return btree_insert_descend(btree_insert_root(key), key, bound, has_bound);
+}
+
+/**
+ * Trava a raiz para inserção, dividindo-a antes se estiver cheia
+ * A troca é feita com a trava acima da raiz, para que nenhum leitor chegue
+ * à raiz antiga depois da divisão
+ */
+static BTreeNode* btree_insert_root(unsigned long long key) {
+    int root_full = btree_node_full(btree_root);
+    if (root_full) pthread_rwlock_wrlock(&btree_root_latch);
+    
+    BTreeNode* root = btree_lock_node(btree_header.root_offset);
+    if (root_full) {
+        long new_root_offset = btree_create_node(0);
+        BTreeNode* new_root = btree_lock_node(new_root_offset);
+        
+        new_root->first_child = root->self_offset;
+        int append = btree_last_append && btree_is_append(root, key);
+        btree_split_child(new_root, 0, root, append ? &key : NULL);
+        btree_set_root(new_root_offset);
+        
+        btree_release_node(root);
+        root = new_root;
+        pthread_rwlock_unlock(&btree_root_latch);
+    }
+    return root;
+}
+
+/**
+ * Desce de um nó não cheio (travado) até a folha da chave e a retorna travada
+ * Descida com acoplamento de travas: o pai só é solto depois que o filho
+ * está travado e, se cheio, dividido; no máximo três páginas ficam presas
+ * bound recebe o menor separador à direita do caminho (limite da folha)
+ */
+static BTreeNode* btree_insert_descend(BTreeNode* node, unsigned long long key, unsigned long long* bound, int* has_bound) {
+    int right_edge = 1;
+    
+    while (!node->is_leaf) {
+        int i = btree_find_child_index(node, key);
+        BTreeNode* child = btree_lock_node(btree_node_child(node, i));
+        
+        if (btree_node_full(child)) {
+            // Divisão enviesada só se a inserção anterior também foi no fim e
+            // só na borda direita: no meio da árvore a página nova ficaria
+            // com poucas chaves para sempre
+            int append = btree_last_append && right_edge && i == node->num_keys &&
+                         btree_is_append(child, key);
+            btree_split_child(node, i, child, append ? &key : NULL);
+            if (btree_slots(node)[i].key <= key) {
+                i++;
+                btree_release_node(child);
+                child = btree_lock_node(btree_node_child(node, i));
+            }
+        }
+        
+        if (i < node->num_keys) {
+            right_edge = 0;
+            if (bound) {
+                *bound = btree_slots(node)[i].key;
+                *has_bound = 1;
+            }
+        }
+        
+        btree_release_node(node);
+        node = child;
+    }
+    
+    return node;
+}
+
+/**
+ * Intercala chaves ordenadas na folha travada (de trás para frente, cada
+ * slot existente é deslocado uma única vez; os registros não se movem)
+ */
+static void btree_insert_into_leaf(BTreeNode* leaf, const BTreeKey* keys, int count) {
+    // Inserção no fim da última folha: a próxima pode seguir o atalho
+    int append = leaf->next_leaf == -1 && btree_is_append(leaf, btree_key_of(&keys[0]));
+    
+    int size = count * ((int)sizeof(BTreeSlot) + BTREE_LEAF_VALUE);
+    if (leaf->heap_start - leaf->num_keys * (int)sizeof(BTreeSlot) < size) {
+        btree_node_compact(leaf);
+    }
+    
+    BTreeSlot* slots = btree_slots(leaf);
+    int i = leaf->num_keys - 1;
+    int k = leaf->num_keys + count - 1;
+    
+    for (int j = count - 1; j >= 0; j--) {
+        unsigned long long key = btree_key_of(&keys[j]);
+        unsigned char record[BTREE_LEAF_VALUE];
+        while (i >= 0 && slots[i].key > key) {
+            slots[k--] = slots[i--];
+        }
+        btree_store_value(record, &keys[j]);
+        btree_node_store(leaf, key, record, &slots[k--]);
+    }
+    
+    leaf->num_keys += count;
+    btree_write_node(leaf->self_offset, leaf);
+    
+    btree_last_append = append;
+    btree_rightmost_leaf = append ? leaf->self_offset : -1;
+}
+
+/**
+ * Indica se a chave fica depois de todas as do nó (inserção no fim)
+ */
+static int btree_is_append(BTreeNode* node, unsigned long long key) {
+    if (node->num_keys == 0) return 1;
+    return btree_slots(node)[node->num_keys - 1].key < key;
+}
+
+/**
+ * Divide filho cheio
+ * Folha: as chaves da direita vão para a nova folha e uma cópia da primeira
+ * delas sobe como separador; a lista de folhas é religada
+ * Interno: a chave do meio sobe e as seguintes vão para o novo nó
+ * append_key (inserções em ordem na borda direita): a folha fica inteira e
+ * a nova começa vazia, separada pela própria chave; o interno fica com
+ * todas menos uma e o novo só com o último filho. As páginas da esquerda
+ * não recebem mais chaves, então ficam cheias em vez de pela metade
+ */
+static void btree_split_child(BTreeNode* parent, int index, BTreeNode* child, const unsigned long long* append_key) {
+    long new_child_offset = btree_create_node(child->is_leaf);
+    BTreeNode* new_child = btree_lock_node(new_child_offset);
+    int count = child->num_keys;
+    int keep = append_key ? count - !child->is_leaf : btree_order / 2 - !child->is_leaf;
+    unsigned long long separator;
+    
+    if (child->is_leaf) {
+        separator = append_key ? *append_key : btree_slots(child)[keep].key;
+        btree_node_append(new_child, child, keep, count - keep);
+        new_child->next_leaf = child->next_leaf;
+        child->next_leaf = new_child_offset;
+    } else {
+        separator = btree_slots(child)[keep].key;
+        new_child->first_child = btree_node_child(child, keep + 1);
+        btree_node_append(new_child, child, keep + 1, count - keep - 1);
+    }
+    btree_node_truncate(child, keep);
+    
+    btree_node_insert(parent, index, separator, &new_child_offset);
+    
+    btree_write_node(parent->self_offset, parent);
+    btree_write_node(child->self_offset, child);
+    btree_write_node(new_child_offset, new_child);
+    
+    btree_release_node(new_child);
+}
+
+/**
+ * Carga em lote (de baixo para cima): substitui todo o índice pelas chaves
+ * As chaves são ordenadas se preciso (o vetor é alterado) e repetidas ou com
+ * nome inválido são descartadas. Folhas são gravadas em sequência com fill_percent% de
+ * ocupação e depois cada nível interno, sem nenhuma descida pela árvore.
+ * Retorna o número de chaves carregadas
+ */
+int btree_bulk_load(BTreeKey* keys, int count, int fill_percent) {
+    if (!btree_check_writable()) return 0;
+    
+    pthread_rwlock_wrlock(&btree_tree_latch);
+    count = btree_rebuild(keys, count, fill_percent);
+    pthread_rwlock_unlock(&btree_tree_latch);
+    return count;
+}
+
+/**
+ * Carga em lote sem travas (chamador tem a árvore só para si)
+ */
+static int btree_rebuild(BTreeKey* keys, int count, int fill_percent) {
+    if (fill_percent <= 0 || fill_percent > 100) fill_percent = BTREE_DEFAULT_FILL;
+    
+    int valid = 0;
+    for (int i = 0; i < count; i++) {
+        if (btree_intern_key(&keys[i])) keys[valid++] = keys[i];
+    }
+    count = valid;
+    
+    int sorted = 1;
+    for (int i = 1; i < count && sorted; i++) {
+        if (btree_compare_keys(&keys[i - 1], &keys[i]) > 0) sorted = 0;
+    }
+    if (!sorted) {
+        qsort(keys, count, sizeof(BTreeKey), btree_compare_key_ptrs);
+    }
+    
+    if (count > 1) {
+        int unique = 1;
+        for (int i = 1; i < count; i++) {
+            if (btree_compare_keys(&keys[i], &keys[unique - 1]) != 0) {
+                keys[unique++] = keys[i];
+            }
+        }
+        count = unique;
+    }
+    
+    // Monta o índice do zero (mesma ordem) em BTREE_TEMP_FILE, que só
+    // substitui o btree.dat depois de completo no disco: uma queda no meio
+    // deixa o índice antigo intacto. O checkpoint abaixo esvazia o log, e a
+    // reconstrução não passa por ele
+    int wal_enabled = btree_wal_enabled;
+    if (btree_root) btree_flush_locked();
+    btree_wal_enabled = 0;
+    
+    if (btree_root) pager_unpin(btree_root, 0);
+    btree_root = NULL;
+    btree_rightmost_leaf = -1;
+    btree_last_append = 0;
+    pager_close();
+    remove(BTREE_TEMP_FILE);
+    if (!pager_open(BTREE_TEMP_FILE, BTREE_PAGE_SIZE, BTREE_POOL_FRAMES)) {
+        exit(1);
+    }
+    long bloom_stamp = btree_header.bloom_stamp;
+    btree_format_header();
+    btree_header.bloom_stamp = bloom_stamp;
+    
+    int* sizes = malloc((count + 1) * sizeof(int));
+    if (!sizes) {
+        fprintf(stderr, "Erro: Falha na alocação da carga em lote\n");
+        exit(1);
+    }
+    
+    int level_count = btree_bulk_plan(count, 1, fill_percent, sizes);
+    long* offsets = malloc(level_count * sizeof(long));
+    unsigned long long* lows = malloc(level_count * sizeof(unsigned long long));
+    if (!offsets || !lows) {
+        fprintf(stderr, "Erro: Falha na alocação da carga em lote\n");
+        exit(1);
+    }
+    
+    // Nível das folhas, já encadeadas
+    BTreeNode* prev = NULL;
+    int pos = 0;
+    for (int i = 0; i < level_count; i++) {
+        int n = sizes[i];
+        long offset = btree_create_node(1);
+        BTreeNode* leaf = btree_lock_node(offset);
+        
+        for (int j = 0; j < n; j++) {
+            unsigned char record[BTREE_LEAF_VALUE];
+            btree_store_value(record, &keys[pos + j]);
+            btree_node_insert(leaf, j, btree_key_of(&keys[pos + j]), record);
+        }
+        btree_write_node(offset, leaf);
+        
+        offsets[i] = offset;
+        if (n > 0) lows[i] = btree_key_of(&keys[pos]);
+        pos += n;
+        
+        if (prev) {
+            prev->next_leaf = offset;
+            btree_write_node(prev->self_offset, prev);
+            btree_release_node(prev);
+        }
+        prev = leaf;
+    }
+    btree_release_node(prev);
     
-    if (file) {
-        fread(&btree_header, sizeof(BTreeHeader), 1, file);
-        btree_root = btree_read_node(btree_header.root_offset);
-        fclose(file);
-    } else {
-        file = fopen("btree.dat", "wb");
-        btree_header.root_offset = btree_create_node(1);
-        btree_header.free_offset = sizeof(BTreeHeader) + sizeof(BTreeNode);
-        btree_header.node_count = 1;
+    // Níveis internos até sobrar um único nó (a raiz)
+    while (level_count > 1) {
+        int parents = btree_bulk_plan(level_count, 0, fill_percent, sizes);
+        pos = 0;
         
-        btree_root = btree_read_node(btree_header.root_offset);
-        btree_update_header();
-        fclose(file);
+        for (int i = 0; i < parents; i++) {
+            int n = sizes[i];
+            long offset = btree_create_node(0);
+            BTreeNode* node = btree_lock_node(offset);
+            
+            node->first_child = offsets[pos];
+            for (int j = 1; j < n; j++) {
+                btree_node_insert(node, j - 1, lows[pos + j], &offsets[pos + j]);
+            }
+            btree_write_node(offset, node);
+            btree_release_node(node);
+            
+            // Reaproveita os vetores: a posição i já foi consumida
+            lows[i] = lows[pos];
+            offsets[i] = offset;
+            pos += n;
+        }
+        level_count = parents;
+    }
+    
+    btree_set_root(offsets[0]);
+    free(offsets);
+    free(lows);
+    free(sizes);
+    
+    // Filtro recriado junto com o índice (compactação limpa as chaves removidas)
+    if (btree_bloom_fp > 0.0) {
+        btree_bloom_reset(2L * count);
+        for (int i = 0; i < count; i++) {
+            bloom_add(btree_bloom, btree_key_of(&keys[i]));
+        }
+    }
+    
+    btree_flush_locked();
+    long root_offset = btree_header.root_offset;
+    pager_unpin(btree_root, 0);
+    btree_root = NULL;
+    pager_sync();
+    pager_close();
+    
+    if (!btree_replace_file(BTREE_TEMP_FILE, "btree.dat")) {
+        fprintf(stderr, "Erro: Não foi possível substituir o btree.dat (índice novo em %s)\n",
+                BTREE_TEMP_FILE);
+        exit(1);
     }
+    if (!pager_open("btree.dat", BTREE_PAGE_SIZE, BTREE_POOL_FRAMES)) {
+        exit(1);
+    }
+    btree_set_root(root_offset);
+    btree_header_dirty = 0;
+    
+    // O log (vazio desde o checkpoint do início) passa a valer sobre o arquivo novo
+    if (wal_enabled) wal_reset();
+    btree_wal_enabled = wal_enabled;
+    return count;
 }
 
 /**
- * Cria novo nó no arquivo
+ * Passa o índice para o arquivo de dados compactado (BTREE_DATA_TEMP_FILE)
+ * e troca o BTREE_DATA_FILE por ele. O chamador gravou nele os registros de
+ * todas as chaves, um depois do outro na ordem das folhas e a partir do
+ * offset 0: o novo offset de cada chave é a soma dos tamanhos anteriores
+ * O cabeçalho marca a troca em andamento antes de qualquer offset mudar;
+ * se o processo cair depois disso, btree_init refaz o cálculo (que dá o
+ * mesmo resultado para chaves já alteradas) e completa o rename
+ * Retorna 0 se o índice está somente para leitura
  */
-static long btree_create_node(int is_leaf) {
-    BTreeNode node;
-    node.is_leaf = is_leaf;
-    node.num_keys = 0;
-    node.self_offset = btree_header.free_offset;
+int btree_relocate_data() {
+    if (!btree_check_writable()) return 0;
     
-    for (int i = 0; i < ORDER; i++) {
-        node.children[i] = -1;
-    }
-    
-    long offset = btree_header.free_offset;
-    btree_header.free_offset += sizeof(BTreeNode);
-    btree_header.node_count++;
+    pthread_rwlock_wrlock(&btree_tree_latch);
+    btree_sync_file(BTREE_DATA_TEMP_FILE);
     
-    FILE* file = fopen("btree.dat", "r+b");
-    fseek(file, offset, SEEK_SET);
-    fwrite(&node, sizeof(BTreeNode), 1, file);
-    fclose(file);
+    btree_header.data_moving = 1;
+    btree_update_header();
+    btree_flush_locked();
+    pager_sync();
     
-    return offset;
+    btree_relocate_finish();
+    pthread_rwlock_unlock(&btree_tree_latch);
+    return 1;
 }
 
 /**
- * Lê nó do arquivo
+ * Regrava os offsets pelas folhas (commit a cada grupo de páginas, para o
+ * conjunto de escrita não prender o pool), troca o arquivo de dados e só
+ * então limpa a marca do cabeçalho (chamador tem a árvore só para si)
  */
-static BTreeNode* btree_read_node(long offset) {
-    if (offset == -1) return NULL;
-    
-    FILE* file = fopen("btree.dat", "rb");
-    fseek(file, offset, SEEK_SET);
+static void btree_relocate_finish() {
+    long position = 0;
+    BTreeNode* leaf = btree_find_leaf_exclusive(0);
+    
+    while (leaf) {
+        int changed = 0;
+        for (int i = 0; i < leaf->num_keys; i++) {
+            BTreeKey key;
+            btree_node_key(leaf, i, &key);
+            if (key.data_offset != position) {
+                key.data_offset = position;
+                btree_store_value(btree_node_record(leaf, i), &key);
+                changed = 1;
+            }
+            position += key.data_size;
+        }
+        if (changed) btree_write_node(leaf->self_offset, leaf);
+        
+        long next = leaf->next_leaf;
+        btree_release_node(leaf);
+        leaf = (next != -1) ? btree_lock_node(next) : NULL;
+        
+        if (btree_txn_count > BTREE_POOL_FRAMES / 4) btree_commit();
+    }
     
-    BTreeNode* node = malloc(sizeof(BTreeNode));
-    fread(node, sizeof(BTreeNode), 1, file);
-    node->self_offset = offset;
+    // Offsets novos no disco antes do rename; o arquivo compactado já pode
+    // ter sido trocado numa execução anterior que caiu antes do fim
+    btree_flush_locked();
+    pager_sync();
+    FILE* moved = fopen(BTREE_DATA_TEMP_FILE, "rb");
+    if (moved) {
+        fclose(moved);
+        if (!btree_replace_file(BTREE_DATA_TEMP_FILE, BTREE_DATA_FILE)) {
+            fprintf(stderr, "Erro: Não foi possível substituir %s por %s\n",
+                    BTREE_DATA_FILE, BTREE_DATA_TEMP_FILE);
+            exit(1);
+        }
+    }
     
-    fclose(file);
-    return node;
+    btree_header.data_moving = 0;
+    btree_update_header();
+    btree_flush_locked();
+    pager_sync();
 }
 
 /**
- * Escreve nó no arquivo
+ * fsync de um arquivo já fechado (pelo nome)
  */
-static void btree_write_node(long offset, BTreeNode* node) {
-    FILE* file = fopen("btree.dat", "r+b");
-    fseek(file, offset, SEEK_SET);
-    fwrite(node, sizeof(BTreeNode), 1, file);
+static void btree_sync_file(const char* filename) {
+    FILE* file = fopen(filename, "rb");
+    if (!file) return;
+
+#ifdef _WIN32
+    _commit(fileno(file));
+#else
+    fsync(fileno(file));
+#endif
     fclose(file);
 }
 
 /**
- * Atualiza cabeçalho do arquivo
+ * Troca filename pelo arquivo temporário já gravado no disco e torna a
+ * troca durável (fsync do diretório). Retorna 0 se o rename falhou
  */
-static void btree_update_header() {
-    FILE* file = fopen("btree.dat", "r+b");
-    fseek(file, 0, SEEK_SET);
-    fwrite(&btree_header, sizeof(BTreeHeader), 1, file);
-    fclose(file);
+static int btree_replace_file(const char* temp_name, const char* filename) {
+    if (rename(temp_name, filename) != 0) {
+        // Windows não substitui um arquivo existente no rename
+        remove(filename);
+        if (rename(temp_name, filename) != 0) return 0;
+    }
+
+#ifndef _WIN32
+    int dir = open(".", O_RDONLY);
+    if (dir >= 0) {
+        fsync(dir);
+        close(dir);
+    }
+#endif
+    return 1;
 }
 
 /**
- * Compara chaves (nome + limiar)
+ * Reescreve o índice de forma densa (offline): lê todas as chaves pelas
+ * folhas e recria o arquivo com a carga em lote, sem páginas livres
+ * Retorna o número de páginas em uso depois da reescrita
  */
-static int btree_compare_keys(const BTreeKey* a, const BTreeKey* b) {
-    int cmp = strcmp(a->name, b->name);
-    return (cmp != 0) ? cmp : (a->threshold - b->threshold);
+int btree_vacuum(int fill_percent) {
+    if (!btree_check_writable()) return btree_header.node_count;
+    
+    pthread_rwlock_wrlock(&btree_tree_latch);
+    
+    int old_used = btree_header.node_count;
+    int old_free = btree_header.free_count;
+    int capacity = 1024;
+    int count = 0;
+    BTreeKey* keys = malloc(capacity * sizeof(BTreeKey));
+    if (!keys) {
+        pthread_rwlock_unlock(&btree_tree_latch);
+        return old_used;
+    }
+    
+    BTreeCursor cursor;
+    BTreeKey key;
+    btree_cursor_start(&cursor, 0, INT_MIN);
+    while (btree_cursor_next(&cursor, &key)) {
+        if (count == capacity) {
+            BTreeKey* temp = realloc(keys, capacity * 2 * sizeof(BTreeKey));
+            if (!temp) {
+                // Sem memória para todas as chaves: mantém o arquivo como está
+                btree_cursor_close(&cursor);
+                free(keys);
+                pthread_rwlock_unlock(&btree_tree_latch);
+                return old_used;
+            }
+            keys = temp;
+            capacity *= 2;
+        }
+        keys[count++] = key;
+    }
+    
+    // As folhas já estão em ordem: a carga não precisa ordenar
+    btree_rebuild(keys, count, fill_percent);
+    free(keys);
+    
+    int used = btree_header.node_count;
+    pthread_rwlock_unlock(&btree_tree_latch);
+    
+    printf("Índice reescrito: %d chaves em %d páginas (antes: %d em uso, %d livres)\n",
+           count, used, old_used, old_free);
+    return used;
 }
 
 /**
- * Insere chave na Árvore-B
+ * Quantos nós usar em um nível da carga em lote: o mais próximo de
+ * items/target que ainda deixa cada nó entre min e max itens
  */
-void btree_insert(BTreeKey key) {
-    if (btree_root->num_keys == MAX_KEYS) {
-        long new_root_offset = btree_create_node(0);
-        BTreeNode* new_root = btree_read_node(new_root_offset);
-        
-        new_root->children[0] = btree_header.root_offset;
-        btree_header.root_offset = new_root_offset;
-        
-        btree_split_child(new_root, 0, btree_root);
-        
-        free(btree_root);
-        btree_root = new_root;
-        
-        btree_insert_non_full(btree_root, key);
-    } else {
-        btree_insert_non_full(btree_root, key);
-    }
+static int btree_bulk_node_count(int items, int target, int min, int max) {
+    if (target < 1) target = 1;
     
-    btree_update_header();
+    int nodes = (items + target / 2) / target;
+    int fewest = (items + max - 1) / max;
+    int most = (min > 0) ? items / min : items;
+    
+    if (nodes > most) nodes = most;
+    if (nodes < fewest) nodes = fewest;
+    return (nodes < 1) ? 1 : nodes;
 }
 
 /**
- * Insere em nó não cheio
+ * Divide um nível da carga em lote: sizes[i] = itens (chaves da folha ou
+ * filhos do nó interno) do nó i; retorna quantos nós
  */
-static void btree_insert_non_full(BTreeNode* node, BTreeKey key) {
-    int i = node->num_keys - 1;
+static int btree_bulk_plan(int items, int is_leaf, int fill_percent, int* sizes) {
+    int nodes = is_leaf
+        ? btree_bulk_node_count(items, btree_max_keys * fill_percent / 100, btree_min_keys, btree_max_keys)
+        : btree_bulk_node_count(items, btree_order * fill_percent / 100, btree_order / 2, btree_order);
     
-    if (node->is_leaf) {
-        while (i >= 0 && btree_compare_keys(&key, &node->keys[i]) < 0) {
-            node->keys[i + 1] = node->keys[i];
-            i--;
-        }
-        
-        node->keys[i + 1] = key;
-        node->num_keys++;
-        btree_write_node(node->self_offset, node);
-    } else {
-        while (i >= 0 && btree_compare_keys(&key, &node->keys[i]) < 0) {
-            i--;
-        }
-        i++;
-        
-        BTreeNode* child = btree_read_node(node->children[i]);
-        
-        if (child->num_keys == MAX_KEYS) {
-            btree_split_child(node, i, child);
-            if (btree_compare_keys(&key, &node->keys[i]) > 0) {
-                i++;
-                free(child);
-                child = btree_read_node(node->children[i]);
-            }
-        }
-        
-        btree_insert_non_full(child, key);
-        free(child);
+    for (int i = 0; i < nodes; i++) {
+        sizes[i] = items / nodes + (i < items % nodes);
     }
+    return nodes;
 }
 
 /**
- * Divide filho cheio
+ * Remove chave da Árvore-B
+ * Descida única com acoplamento de travas: antes de descer, garante que o
+ * filho está acima do mínimo, então a remoção na folha nunca precisa voltar
+ * para rebalancear. Pai, filho e irmão ficam fixados e travados só enquanto
+ * são usados e os ajustes recebem os próprios nós, sem reler páginas pelo
+ * offset. Nome que nunca foi cadastrado não tem chaves para remover
  */
-static void btree_split_child(BTreeNode* parent, int index, BTreeNode* child) {
-    long new_child_offset = btree_create_node(child->is_leaf);
-    BTreeNode* new_child = btree_read_node(new_child_offset);
+void btree_delete(const char* name, int threshold) {
+    if (!btree_check_writable()) return;
     
-    new_child->num_keys = MIN_KEYS;
+    unsigned int name_id = names_find(name);
+    if (name_id == NAMES_NONE) return;
+    unsigned long long key = btree_key_value(name_id, threshold);
     
-    for (int j = 0; j < MIN_KEYS; j++) {
-        new_child->keys[j] = child->keys[j + ORDER / 2];
-    }
+    pthread_rwlock_rdlock(&btree_tree_latch);
+    pthread_mutex_lock(&btree_write_mutex);
     
-    if (!child->is_leaf) {
-        for (int j = 0; j <= MIN_KEYS; j++) {
-            new_child->children[j] = child->children[j + ORDER / 2];
-        }
-    }
+    // Raiz interna com uma chave pode ser esvaziada pela fusão dos dois filhos
+    // (mesmo quando a chave não existe): a troca exige a trava acima da raiz
+    int root_latched = !btree_root->is_leaf && btree_root->num_keys <= 1;
+    if (root_latched) pthread_rwlock_wrlock(&btree_root_latch);
     
-    child->num_keys = MIN_KEYS;
+    BTreeNode* node = btree_lock_node(btree_header.root_offset);
     
-    for (int j = parent->num_keys; j > index; j--) {
-        parent->children[j + 1] = parent->children[j];
+    while (!node->is_leaf) {
+        int idx = btree_find_child_index(node, key);
+        BTreeNode* child = btree_lock_node(btree_node_child(node, idx));
+        
+        if (btree_node_minimal(child)) {
+            child = btree_fill_child(node, idx, child);
+        }
+        
+        if (root_latched) {
+            if (node->num_keys == 0) {
+                btree_set_root(child->self_offset);
+                btree_free_node(node);
+                node = NULL;
+            }
+            pthread_rwlock_unlock(&btree_root_latch);
+            root_latched = 0;
+        }
+        
+        btree_release_node(node);
+        node = child;
     }
-    parent->children[index + 1] = new_child_offset;
     
-    for (int j = parent->num_keys - 1; j >= index; j--) {
-        parent->keys[j + 1] = parent->keys[j];
+    int idx = btree_find_key_index(node, key);
+    if (idx < node->num_keys && btree_slots(node)[idx].key == key) {
+        btree_remove_from_leaf(node, idx);
+        
+        // Bits não podem ser desligados (seriam de outras chaves também)
+        if (btree_bloom) {
+            btree_bloom_touch();
+            btree_bloom->removed++;
+            if (btree_bloom->removed > btree_bloom->capacity / 2) btree_bloom_stale = 1;
+        }
     }
+    btree_release_node(node);
     
-    parent->keys[index] = child->keys[MIN_KEYS];
-    parent->num_keys++;
-    
-    btree_write_node(parent->self_offset, parent);
-    btree_write_node(child->self_offset, child);
-    btree_write_node(new_child_offset, new_child);
+    btree_update_header();
+    btree_commit();
+    int refresh = btree_bloom_stale;
+    pthread_mutex_unlock(&btree_write_mutex);
+    pthread_rwlock_unlock(&btree_tree_latch);
     
-    free(new_child);
+    if (refresh) btree_bloom_refresh();
 }
 
 /**
- * Remove chave da Árvore-B
+ * Encontra índice da primeira chave >= key no nó (busca binária só nos
+ * slots, comparando inteiros de 64 bits)
  */
-void btree_delete(const char* name, int threshold) {
-    BTreeKey key;
-    strncpy(key.name, name, MAX_NAME_LEN - 1);
-    key.name[MAX_NAME_LEN - 1] = '\0';
-    key.threshold = threshold;
-    
-    if (btree_delete_recursive(btree_header.root_offset, key)) {
-        if (btree_root->num_keys == 0 && !btree_root->is_leaf) {
-            long old_root = btree_header.root_offset;
-            btree_header.root_offset = btree_root->children[0];
-            
-            free(btree_root);
-            btree_root = btree_read_node(btree_header.root_offset);
-            btree_update_header();
+static int btree_find_key_index(BTreeNode* node, unsigned long long key) {
+    const BTreeSlot* slots = btree_slots(node);
+    int low = 0, high = node->num_keys;
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (slots[mid].key < key) {
+            low = mid + 1;
+        } else {
+            high = mid;
         }
     }
+    return low;
 }
 
 /**
- * Função recursiva de remoção (página por página)
+ * Encontra o filho que cobre a chave (primeiro separador > key)
  */
-static int btree_delete_recursive(long node_offset, BTreeKey key) {
-    BTreeNode* node = btree_read_node(node_offset);
-    int idx = btree_find_key_index(node, &key);
-    
-    if (idx < node->num_keys && btree_compare_keys(&node->keys[idx], &key) == 0) {
-        if (node->is_leaf) {
-            btree_remove_from_leaf(node_offset, idx);
+static int btree_find_child_index(BTreeNode* node, unsigned long long key) {
+    const BTreeSlot* slots = btree_slots(node);
+    int low = 0, high = node->num_keys;
+    while (low < high) {
+        int mid = (low + high) / 2;
+        if (slots[mid].key <= key) {
+            low = mid + 1;
         } else {
-            btree_remove_from_non_leaf(node_offset, idx);
+            high = mid;
         }
-        free(node);
-        return 1;
-    }
-    
-    if (node->is_leaf) {
-        free(node);
-        return 0;
     }
-    
-    int last_child = (idx == node->num_keys);
-    BTreeNode* child = btree_read_node(node->children[idx]);
-    
-    if (child->num_keys < MIN_KEYS) {
-        btree_fill_child(node_offset, idx);
-        free(node);
-        node = btree_read_node(node_offset);
-        idx = btree_find_key_index(node, &key);
-        if (last_child && idx > node->num_keys) idx = node->num_keys;
-    }
-    
-    long next_child = (idx > node->num_keys) ? 
-                     node->children[node->num_keys] : node->children[idx];
-    
-    int result = btree_delete_recursive(next_child, key);
-    free(node);
-    free(child);
-    return result;
+    return low;
 }
 
 /**
- * Encontra índice da chave no nó
+ * Remove chave de uma folha travada
  */
-static int btree_find_key_index(BTreeNode* node, const BTreeKey* key) {
-    int idx = 0;
-    while (idx < node->num_keys && btree_compare_keys(&node->keys[idx], key) < 0) {
-        idx++;
-    }
-    return idx;
+static void btree_remove_from_leaf(BTreeNode* leaf, int idx) {
+    btree_node_remove(leaf, idx);
+    btree_write_node(leaf->self_offset, leaf);
 }
 
 /**
- * Remove chave de nó folha
+ * Preenche filho com poucas chaves (pai e filho já travados)
+ * Tenta emprestar do irmão anterior, depois do seguinte; senão funde com
+ * um deles. Retorna o nó travado que agora cobre a faixa do filho (o
+ * próprio filho ou, na fusão com o anterior, o irmão)
  */
-static void btree_remove_from_leaf(long node_offset, int idx) {
-    BTreeNode* node = btree_read_node(node_offset);
-    
-    for (int i = idx + 1; i < node->num_keys; i++) {
-        node->keys[i - 1] = node->keys[i];
+static BTreeNode* btree_fill_child(BTreeNode* node, int idx, BTreeNode* child) {
+    if (idx != 0) {
+        BTreeNode* left_sibling = btree_lock_node(btree_node_child(node, idx - 1));
+        if (btree_node_can_lend(left_sibling)) {
+            btree_borrow_from_prev(node, idx, child, left_sibling);
+            btree_release_node(left_sibling);
+            return child;
+        }
+        
+        // Último filho: só resta fundir com o anterior
+        if (idx == node->num_keys) {
+            if (btree_merge(node, idx - 1, left_sibling, child)) return left_sibling;
+            btree_release_node(left_sibling);
+            return child;
+        }
+        btree_release_node(left_sibling);
     }
     
-    node->num_keys--;
-    btree_write_node(node_offset, node);
-    free(node);
+    if (idx == node->num_keys) return child;
+    
+    BTreeNode* right_sibling = btree_lock_node(btree_node_child(node, idx + 1));
+    if (btree_node_can_lend(right_sibling)) {
+        btree_borrow_from_next(node, idx, child, right_sibling);
+    } else if (btree_merge(node, idx, child, right_sibling)) {
+        return child;
+    }
+    btree_release_node(right_sibling);
+    return child;
 }
 
 /**
- * Remove chave de nó interno
+ * Empréstimo do irmão anterior
  */
-static void btree_remove_from_non_leaf(long node_offset, int idx) {
-    BTreeNode* node = btree_read_node(node_offset);
-    BTreeKey key = node->keys[idx];
-    
-    BTreeNode* left_child = btree_read_node(node->children[idx]);
-    
-    if (left_child->num_keys >= MIN_KEYS) {
-        BTreeKey pred = btree_get_predecessor(node_offset, idx);
-        node->keys[idx] = pred;
-        btree_write_node(node_offset, node);
-        btree_delete_recursive(node->children[idx], pred);
+static void btree_borrow_from_prev(BTreeNode* node, int idx, BTreeNode* child, BTreeNode* left_sibling) {
+    BTreeSlot* parent_slots = btree_slots(node);
+    int last = left_sibling->num_keys - 1;
+    
+    if (child->is_leaf) {
+        // Folha: a última chave do irmão passa para o filho e vira separador
+        btree_node_insert(child, 0, btree_slots(left_sibling)[last].key, btree_node_record(left_sibling, last));
+        parent_slots[idx - 1].key = btree_slots(child)[0].key;
     } else {
-        BTreeNode* right_child = btree_read_node(node->children[idx + 1]);
-        if (right_child->num_keys >= MIN_KEYS) {
-            BTreeKey succ = btree_get_successor(node_offset, idx);
-            node->keys[idx] = succ;
-            btree_write_node(node_offset, node);
-            btree_delete_recursive(node->children[idx + 1], succ);
-        } else {
-            btree_merge(node_offset, idx);
-            btree_delete_recursive(node->children[idx], key);
-        }
-        free(right_child);
+        btree_node_insert(child, 0, parent_slots[idx - 1].key, &child->first_child);
+        child->first_child = btree_node_child(left_sibling, last + 1);
+        parent_slots[idx - 1].key = btree_slots(left_sibling)[last].key;
     }
+    btree_node_remove(left_sibling, last);
     
-    free(node);
-    free(left_child);
+    btree_write_node(node->self_offset, node);
+    btree_write_node(child->self_offset, child);
+    btree_write_node(left_sibling->self_offset, left_sibling);
 }
 
 /**
- * Obtém predecessor da chave
+ * Empréstimo do irmão seguinte
  */
-static BTreeKey btree_get_predecessor(long node_offset, int idx) {
-    BTreeNode* node = btree_read_node(node_offset);
-    long current = node->children[idx];
-    free(node);
+static void btree_borrow_from_next(BTreeNode* node, int idx, BTreeNode* child, BTreeNode* right_sibling) {
+    BTreeSlot* parent_slots = btree_slots(node);
     
-    while (1) {
-        BTreeNode* curr_node = btree_read_node(current);
-        if (curr_node->is_leaf) {
-            BTreeKey pred = curr_node->keys[curr_node->num_keys - 1];
-            free(curr_node);
-            return pred;
-        }
-        long next = curr_node->children[curr_node->num_keys];
-        free(curr_node);
-        current = next;
+    if (child->is_leaf) {
+        // Folha: o separador passa a ser a segunda chave do irmão
+        btree_node_append(child, right_sibling, 0, 1);
+        parent_slots[idx].key = btree_slots(right_sibling)[1].key;
+    } else {
+        btree_node_insert(child, child->num_keys, parent_slots[idx].key, &right_sibling->first_child);
+        parent_slots[idx].key = btree_slots(right_sibling)[0].key;
+        right_sibling->first_child = btree_node_child(right_sibling, 1);
     }
+    btree_node_remove(right_sibling, 0);
+    
+    btree_write_node(node->self_offset, node);
+    btree_write_node(child->self_offset, child);
+    btree_write_node(right_sibling->self_offset, right_sibling);
 }
 
 /**
- * Obtém successor da chave
+ * Funde dois filhos (o da direita é liberado e devolvido à lista de livres)
+ * Folhas não recebem o separador (ele é só uma cópia) e herdam o encadeamento
+ * Retorna 0, sem alterar nada, se as chaves não cabem em um nó (só com nós
+ * abaixo do mínimo deixados pela divisão enviesada)
  */
-static BTreeKey btree_get_successor(long node_offset, int idx) {
-    BTreeNode* node = btree_read_node(node_offset);
-    long current = node->children[idx + 1];
-    free(node);
+static int btree_merge(BTreeNode* node, int idx, BTreeNode* child, BTreeNode* right_sibling) {
+    if (child->num_keys + right_sibling->num_keys + !child->is_leaf > btree_max_keys) return 0;
     
-    while (1) {
-        BTreeNode* curr_node = btree_read_node(current);
-        if (curr_node->is_leaf) {
-            BTreeKey succ = curr_node->keys[0];
-            free(curr_node);
-            return succ;
-        }
-        long next = curr_node->children[0];
-        free(curr_node);
-        current = next;
+    if (!child->is_leaf) {
+        btree_node_insert(child, child->num_keys, btree_slots(node)[idx].key, &right_sibling->first_child);
     }
+    btree_node_append(child, right_sibling, 0, right_sibling->num_keys);
+    if (child->is_leaf) child->next_leaf = right_sibling->next_leaf;
+    btree_node_remove(node, idx);
+    
+    btree_write_node(node->self_offset, node);
+    btree_write_node(child->self_offset, child);
+    
+    btree_free_node(right_sibling);
+    return 1;
 }
 
 /**
- * Preenche filho com poucas chaves
+ * Desce da raiz até a folha que cobre a chave (folha fica travada para
+ * leitura); cada filho é travado antes de soltar o pai
  */
-static void btree_fill_child(long node_offset, int idx) {
-    BTreeNode* node = btree_read_node(node_offset);
-    
-    if (idx != 0) {
-        BTreeNode* left_sibling = btree_read_node(node->children[idx - 1]);
-        if (left_sibling->num_keys >= MIN_KEYS) {
-            btree_borrow_from_prev(node_offset, idx);
-            free(left_sibling);
-            free(node);
-            return;
-        }
-        free(left_sibling);
+static BTreeNode* btree_find_leaf(unsigned long long key) {
+    pthread_rwlock_rdlock(&btree_root_latch);
+    BTreeNode* node = btree_read_node(btree_header.root_offset);
+    pthread_rwlock_unlock(&btree_root_latch);
+    
+    while (!node->is_leaf) {
+        BTreeNode* child = btree_read_node(btree_node_child(node, btree_find_child_index(node, key)));
+        btree_release_node(node);
+        node = child;
     }
     
-    if (idx != node->num_keys) {
-        BTreeNode* right_sibling = btree_read_node(node->children[idx + 1]);
-        if (right_sibling->num_keys >= MIN_KEYS) {
-            btree_borrow_from_next(node_offset, idx);
-            free(right_sibling);
-            free(node);
-            return;
-        }
-        free(right_sibling);
-    }
+    return node;
+}
+
+/**
+ * Mesma descida para o escritor, com travas exclusivas
+ */
+static BTreeNode* btree_find_leaf_exclusive(unsigned long long key) {
+    BTreeNode* node = btree_lock_node(btree_header.root_offset);
     
-    if (idx != node->num_keys) {
-        btree_merge(node_offset, idx);
-    } else {
-        btree_merge(node_offset, idx - 1);
+    while (!node->is_leaf) {
+        BTreeNode* child = btree_lock_node(btree_node_child(node, btree_find_child_index(node, key)));
+        btree_release_node(node);
+        node = child;
     }
     
-    free(node);
+    return node;
 }
 
 /**
- * Empréstimo do irmão anterior
+ * Busca chave na Árvore-B
+ * O nome vira id uma vez (nome nunca cadastrado não está no índice) e a
+ * descida só compara inteiros. Tenta primeiro a leitura otimista (sem
+ * travas); se um escritor alterar alguma página do caminho, recorre à
+ * descida com travas compartilhadas
  */
-static void btree_borrow_from_prev(long node_offset, int idx) {
-    BTreeNode* node = btree_read_node(node_offset);
-    BTreeNode* child = btree_read_node(node->children[idx]);
-    BTreeNode* left_sibling = btree_read_node(node->children[idx - 1]);
+int btree_search(const char* name, int threshold, BTreeKey* result) {
+    unsigned int name_id = names_find(name);
+    if (name_id == NAMES_NONE) return 0;
+    unsigned long long key = btree_key_value(name_id, threshold);
     
-    for (int i = child->num_keys - 1; i >= 0; i--) {
-        child->keys[i + 1] = child->keys[i];
-    }
+    pthread_rwlock_rdlock(&btree_tree_latch);
     
-    if (!child->is_leaf) {
-        for (int i = child->num_keys; i >= 0; i--) {
-            child->children[i + 1] = child->children[i];
-        }
+    // Chave ausente do filtro: certamente não está no índice
+    BloomFilter* bloom = __atomic_load_n(&btree_bloom, __ATOMIC_ACQUIRE);
+    if (bloom && !bloom_may_contain(bloom, key)) {
+        pthread_rwlock_unlock(&btree_tree_latch);
+        return 0;
     }
     
-    child->keys[0] = node->keys[idx - 1];
-    
-    if (!child->is_leaf) {
-        child->children[0] = left_sibling->children[left_sibling->num_keys];
+    int found = 0;
+    int done = 0;
+    for (int attempt = 0; attempt < BTREE_OPTIMISTIC_TRIES && !done; attempt++) {
+        done = btree_search_optimistic(key, result, &found);
     }
     
-    child->num_keys++;
-    node->keys[idx - 1] = left_sibling->keys[left_sibling->num_keys - 1];
-    left_sibling->num_keys--;
-    
-    btree_write_node(node_offset, node);
-    btree_write_node(child->self_offset, child);
-    btree_write_node(left_sibling->self_offset, left_sibling);
+    if (!done) {
+        BTreeNode* leaf = btree_find_leaf(key);
+        int i = btree_find_key_index(leaf, key);
+        found = i < leaf->num_keys && btree_slots(leaf)[i].key == key;
+        
+        if (found) btree_node_key(leaf, i, result);
+        btree_release_node(leaf);
+    }
     
-    free(node);
-    free(child);
-    free(left_sibling);
+    if (!found && bloom) bloom_note_false_positive(bloom);
+    pthread_rwlock_unlock(&btree_tree_latch);
+    return found;
 }
 
 /**
- * Empréstimo do irmão seguinte
+ * Descida otimista: lê as páginas só fixadas e confere no fim de cada uma
+ * que a versão não mudou (versão ímpar = escritor alterando a página)
+ * Retorna 0 se precisa repetir; senão preenche found/result
  */
-static void btree_borrow_from_next(long node_offset, int idx) {
-    BTreeNode* node = btree_read_node(node_offset);
-    BTreeNode* child = btree_read_node(node->children[idx]);
-    BTreeNode* right_sibling = btree_read_node(node->children[idx + 1]);
+static int btree_search_optimistic(unsigned long long key, BTreeKey* result, int* found) {
+    long offset = __atomic_load_n(&btree_header.root_offset, __ATOMIC_ACQUIRE);
+    BTreeNode* node = pager_pin(offset);
+    if (!node) return 0;
     
-    child->keys[child->num_keys] = node->keys[idx];
-    child->num_keys++;
+    unsigned long version = pager_page_version(node);
     
-    if (!child->is_leaf) {
-        child->children[child->num_keys] = right_sibling->children[0];
+    // A raiz pode ter sido trocada entre a leitura do offset e a fixação
+    if ((version & 1) || offset != __atomic_load_n(&btree_header.root_offset, __ATOMIC_ACQUIRE)) {
+        pager_unpin(node, 0);
+        return 0;
     }
     
-    node->keys[idx] = right_sibling->keys[0];
-    
-    for (int i = 1; i < right_sibling->num_keys; i++) {
-        right_sibling->keys[i - 1] = right_sibling->keys[i];
+    for (;;) {
+        int num_keys = node->num_keys;
+        if (num_keys < 0 || num_keys > btree_max_keys) break;
+        
+        if (node->is_leaf) {
+            int i = btree_find_key_index(node, key);
+            BTreeKey copy;
+            int match = i < num_keys && btree_slots(node)[i].key == key;
+            if (match) btree_node_key(node, i, &copy);
+            
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            if (pager_page_version(node) != version) break;
+            
+            pager_unpin(node, 0);
+            *found = match;
+            if (match) *result = copy;
+            return 1;
+        }
+        
+        long child_offset = btree_node_child(node, btree_find_child_index(node, key));
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (pager_page_version(node) != version) break;
+        
+        BTreeNode* child = pager_pin(child_offset);
+        if (!child) break;
+        unsigned long child_version = pager_page_version(child);
+        
+        // O pai ainda igual garante que o filho lido era mesmo o do caminho
+        if ((child_version & 1) || pager_page_version(node) != version) {
+            pager_unpin(child, 0);
+            break;
+        }
+        
+        pager_unpin(node, 0);
+        node = child;
+        version = child_version;
     }
     
-    if (!right_sibling->is_leaf) {
-        for (int i = 1; i <= right_sibling->num_keys; i++) {
-            right_sibling->children[i - 1] = right_sibling->children[i];
-        }
+    pager_unpin(node, 0);
+    return 0;
+}
+
+/**
+ * Posiciona o cursor na primeira chave >= (name, threshold)
+ * Nome vazio começa no início do índice; nome nunca cadastrado deixa o
+ * cursor no fim. Retorna 1 se existe chave a partir da posição
+ */
+int btree_seek(BTreeCursor* cursor, const char* name, int threshold) {
+    unsigned int name_id = 0;
+    if (!name || name[0] == '\0') {
+        threshold = INT_MIN;
+    } else if ((name_id = names_find(name)) == NAMES_NONE) {
+        cursor->leaf = NULL;
+        cursor->has_last = 0;
+        return 0;
     }
     
-    right_sibling->num_keys--;
+    pthread_rwlock_rdlock(&btree_tree_latch);
     
-    btree_write_node(node_offset, node);
-    btree_write_node(child->self_offset, child);
-    btree_write_node(right_sibling->self_offset, right_sibling);
+    btree_cursor_start(cursor, name_id, threshold);
+    int found = btree_cursor_settle(cursor);
+    if (found) pager_unlatch(cursor->leaf);
     
-    free(node);
-    free(child);
-    free(right_sibling);
+    pthread_rwlock_unlock(&btree_tree_latch);
+    return found;
 }
 
 /**
- * Funde dois filhos
+ * Copia a chave sob o cursor e avança
+ * Retorna 0 no fim das folhas (o cursor é liberado automaticamente)
  */
-static void btree_merge(long node_offset, int idx) {
-    BTreeNode* node = btree_read_node(node_offset);
-    BTreeNode* child = btree_read_node(node->children[idx]);
-    BTreeNode* right_sibling = btree_read_node(node->children[idx + 1]);
-    
-    child->keys[MIN_KEYS - 1] = node->keys[idx];
-    
-    for (int i = 0; i < right_sibling->num_keys; i++) {
-        child->keys[i + MIN_KEYS] = right_sibling->keys[i];
+int btree_next(BTreeCursor* cursor, BTreeKey* key) {
+    pthread_rwlock_rdlock(&btree_tree_latch);
+    int found = btree_cursor_next(cursor, key);
+    pthread_rwlock_unlock(&btree_tree_latch);
+    return found;
+}
+
+/**
+ * Regrava os dados da última chave devolvida por btree_next
+ * (nome e limiar não podem mudar: a posição na árvore seria outra)
+ */
+void btree_cursor_update(BTreeCursor* cursor, const BTreeKey* key) {
+    if (!cursor->leaf || !cursor->has_last || btree_compare_keys(&cursor->last, key) != 0) return;
+    if (!btree_check_writable()) return;
+    
+    pthread_rwlock_rdlock(&btree_tree_latch);
+    pthread_mutex_lock(&btree_write_mutex);
+    
+    // Folha do cursor intacta: altera direto; senão procura a chave de novo
+    int unchanged = pager_page_version(cursor->leaf) == cursor->version;
+    unsigned long long value = btree_key_of(key);
+    BTreeNode* leaf = unchanged ? btree_lock_node(cursor->leaf->self_offset)
+                                : btree_find_leaf_exclusive(value);
+    
+    int i = btree_find_key_index(leaf, value);
+    if (i < leaf->num_keys && btree_slots(leaf)[i].key == value) {
+        btree_store_value(btree_node_record(leaf, i), key);
+        btree_write_node(leaf->self_offset, leaf);
     }
+    btree_release_node(leaf);
     
-    if (!child->is_leaf) {
-        for (int i = 0; i <= right_sibling->num_keys; i++) {
-            child->children[i + MIN_KEYS] = right_sibling->children[i];
-        }
-    }
+    // A alteração é do próprio cursor: não precisa se reposicionar depois
+    if (unchanged) cursor->version = pager_page_version(cursor->leaf);
     
-    for (int i = idx + 1; i < node->num_keys; i++) {
-        node->keys[i - 1] = node->keys[i];
-    }
+    btree_commit();
+    pthread_mutex_unlock(&btree_write_mutex);
+    pthread_rwlock_unlock(&btree_tree_latch);
+}
+
+/**
+ * Prepara o cursor para começar em (name_id, threshold) e o posiciona
+ */
+static void btree_cursor_start(BTreeCursor* cursor, unsigned int name_id, int threshold) {
+    memset(&cursor->last, 0, sizeof(BTreeKey));
+    cursor->last.name_id = name_id;
+    cursor->last.threshold = threshold;
+    cursor->has_last = 0;
+    btree_cursor_position(cursor);
+}
+
+/**
+ * (Re)posiciona o cursor pela chave guardada: a partir dela ou logo depois
+ * da última devolvida. A folha fica fixada, sem trava, com a versão anotada
+ */
+static void btree_cursor_position(BTreeCursor* cursor) {
+    unsigned long long key = btree_key_of(&cursor->last);
+    BTreeNode* leaf = btree_find_leaf(key);
+    int index = btree_find_key_index(leaf, key);
     
-    for (int i = idx + 2; i <= node->num_keys; i++) {
-        node->children[i - 1] = node->children[i];
+    if (cursor->has_last && index < leaf->num_keys && btree_slots(leaf)[index].key == key) {
+        index++;
     }
     
-    child->num_keys += right_sibling->num_keys + 1;
-    node->num_keys--;
-    
-    btree_write_node(node_offset, node);
-    btree_write_node(child->self_offset, child);
-    
-    free(node);
-    free(child);
-    free(right_sibling);
+    cursor->leaf = leaf;
+    cursor->index = index;
+    cursor->version = pager_page_version(leaf);
+    pager_unlatch(leaf);
 }
 
 /**
- * Busca chave na Árvore-B
+ * Leva o cursor até uma chave válida, pulando fins de folha
+ * Retorna 1 com a folha travada para leitura, ou 0 no fim (cursor liberado)
  */
-int btree_search(const char* name, int threshold, BTreeKey* result) {
-    BTreeNode* current = btree_root;
-    BTreeKey key;
-    strncpy(key.name, name, MAX_NAME_LEN - 1);
-    key.name[MAX_NAME_LEN - 1] = '\0';
-    key.threshold = threshold;
-    
-    while (current) {
-        int i = 0;
-        while (i < current->num_keys && btree_compare_keys(&key, &current->keys[i]) > 0) {
-            i++;
+static int btree_cursor_settle(BTreeCursor* cursor) {
+    while (cursor->leaf) {
+        BTreeNode* leaf = cursor->leaf;
+        pager_latch(leaf, 0);
+        
+        // Outra thread alterou a folha: recomeça pela última chave
+        if (pager_page_version(leaf) != cursor->version) {
+            btree_release_node(leaf);
+            btree_cursor_position(cursor);
+            continue;
         }
         
-        if (i < current->num_keys && btree_compare_keys(&key, &current->keys[i]) == 0) {
-            *result = current->keys[i];
-            if (current != btree_root) free(current);
-            return 1;
+        if (cursor->index < leaf->num_keys) return 1;
+        
+        if (leaf->next_leaf == -1) {
+            btree_release_node(leaf);
+            cursor->leaf = NULL;
+            return 0;
         }
         
-        if (current->is_leaf) break;
+        BTreeNode* next = btree_step_right(leaf);
+        if (!next) {
+            btree_cursor_position(cursor);
+            continue;
+        }
         
-        long next = current->children[i];
-        if (current != btree_root) free(current);
-        current = btree_read_node(next);
+        cursor->leaf = next;
+        cursor->index = 0;
+        cursor->version = pager_page_version(next);
+        pager_unlatch(next);
     }
-    
-    if (current && current != btree_root) free(current);
     return 0;
 }
 
 /**
- * Percurso in-order para impressão ordenada
+ * btree_next sem a trava da árvore (chamador já a segura)
  */
-void btree_print_inorder() {
-    printf("\n=== CHAVES EM ORDEM CRESCENTE ===\n");
-    btree_print_inorder_recursive(btree_header.root_offset);
-    printf("==================================\n");
+static int btree_cursor_next(BTreeCursor* cursor, BTreeKey* key) {
+    if (!btree_cursor_settle(cursor)) return 0;
+    
+    btree_node_key(cursor->leaf, cursor->index++, key);
+    cursor->last = *key;
+    cursor->has_last = 1;
+    pager_unlatch(cursor->leaf);
+    return 1;
 }
 
-static void btree_print_inorder_recursive(long node_offset) {
-    BTreeNode* node = btree_read_node(node_offset);
-    
-    for (int i = 0; i < node->num_keys; i++) {
-        if (!node->is_leaf) {
-            btree_print_inorder_recursive(node->children[i]);
-        }
-        printf("Nome: %-20s | Limiar: %3d | Dimensões: %4dx%4d\n",
-               node->keys[i].name, node->keys[i].threshold,
-               node->keys[i].width, node->keys[i].height);
+/**
+ * Passa da folha travada para a seguinte sem segurar duas travas (um leitor
+ * esperando à direita poderia travar com um escritor que vai à esquerda)
+ * Solta a folha; retorna a seguinte travada ou NULL se a folha mudou no meio
+ * (fusão ou empréstimo com a seguinte sempre alteram a anterior)
+ */
+static BTreeNode* btree_step_right(BTreeNode* leaf) {
+    long next_offset = leaf->next_leaf;
+    unsigned long version = pager_page_version(leaf);
+    pager_unlatch(leaf);
+    
+    BTreeNode* next = btree_read_node(next_offset);
+    int changed = pager_page_version(leaf) != version;
+    pager_unpin(leaf, 0);
+    
+    if (changed) {
+        btree_release_node(next);
+        return NULL;
     }
+    return next;
+}
+
+/**
+ * Libera a folha fixada pelo cursor (necessário ao parar antes do fim)
+ */
+void btree_cursor_close(BTreeCursor* cursor) {
+    if (cursor->leaf) pager_unpin(cursor->leaf, 0);
+    cursor->leaf = NULL;
+}
+
+/**
+ * Percurso pelas folhas encadeadas, na ordem das chaves: nomes agrupados na
+ * ordem de cadastro (id) e, em cada nome, limiares crescentes. A listagem
+ * em ordem alfabética é database_list_images
+ */
+void btree_print_inorder() {
+    BTreeCursor cursor;
+    BTreeKey key;
     
-    if (!node->is_leaf) {
-        btree_print_inorder_recursive(node->children[node->num_keys]);
+    printf("\n=== CHAVES EM ORDEM CRESCENTE (ID DO NOME, LIMIAR) ===\n");
+    btree_seek(&cursor, "", INT_MIN);
+    while (btree_next(&cursor, &key)) {
+        printf("Nome: %-20s | Limiar: %3d | Dimensões: %4dx%4d\n",
+               key.name, key.threshold, key.width, key.height);
     }
-    
-    free(node);
+    printf("==================================\n");
 }
 
 /**
  * Imprime conteúdo de todas as páginas
  */
 void btree_print_pages() {
+    // Sem escritores durante a impressão: páginas e cabeçalho ficam coerentes
+    pthread_rwlock_rdlock(&btree_tree_latch);
+    pthread_mutex_lock(&btree_write_mutex);
+    
     printf("\n=== CONTEÚDO DAS PÁGINAS DA ÁRVORE-B ===\n");
-    printf("Ordem: %d | Total de páginas: %d | Offset da raiz: %ld\n\n", 
-           ORDER, btree_header.node_count, btree_header.root_offset);
+    printf("Ordem: %d | Páginas em uso: %d | Páginas livres: %d | Offset da raiz: %ld\n\n", 
+           btree_order, btree_header.node_count, btree_header.free_count, btree_header.root_offset);
     
-    long offset = sizeof(BTreeHeader);
-    for (int i = 1; i <= btree_header.node_count; i++) {
+    long offset = BTREE_PAGE_SIZE;
+    for (int i = 1; offset < btree_header.free_offset; i++) {
         BTreeNode* node = btree_read_node(offset);
         
         printf("Página %d (Offset: %ld): ", i, offset);
+        
+        if (node->is_leaf == BTREE_PAGE_FREE) {
+            printf("[LIVRE] Próxima livre: %ld\n", node->next_leaf);
+            btree_release_node(node);
+            offset += BTREE_PAGE_SIZE;
+            continue;
+        }
+        
         printf("[%s] ", node->is_leaf ? "FOLHA" : "INTERNO");
-        printf("Chaves: %d | ", node->num_keys);
+        printf("Chaves: %d | Livre: %d bytes | ", node->num_keys, btree_node_free_space(node));
         
         if (node->num_keys > 0) {
             printf("Conteúdo: ");
             for (int j = 0; j < node->num_keys; j++) {
-                printf("\"%s\",limiar=%d", node->keys[j].name, node->keys[j].threshold);
+                BTreeKey key;
+                btree_node_key(node, j, &key);
+                printf("\"%s\",limiar=%d", key.name, key.threshold);
                 if (j < node->num_keys - 1) printf(" | ");
             }
         } else {
             printf("VAZIA");
         }
         
-        if (!node->is_leaf && node->num_keys > 0) {
+        if (node->is_leaf) {
+            printf(" | Próxima folha: %ld", node->next_leaf);
+        } else if (node->num_keys > 0) {
             printf(" | Filhos: ");
             for (int j = 0; j <= node->num_keys; j++) {
-                if (node->children[j] != -1) {
-                    printf("%ld", node->children[j]);
-                    if (j < node->num_keys) printf(", ");
-                }
+                printf("%ld", btree_node_child(node, j));
+                if (j < node->num_keys) printf(", ");
             }
         }
         printf("\n");
         
-        free(node);
-        offset += sizeof(BTreeNode);
+        btree_release_node(node);
+        offset += BTREE_PAGE_SIZE;
     }
+    pager_print_stats();
+    if (btree_wal_enabled) wal_print_stats();
+    if (btree_bloom) bloom_print_stats(btree_bloom);
+    names_print_stats();
     printf("==========================================\n");
+    
+    pthread_mutex_unlock(&btree_write_mutex);
+    pthread_rwlock_unlock(&btree_tree_latch);
 }
 
 /**
  * Retorna offset da raiz (para uso em image.c)
  */
 long btree_get_root_offset() {
-    return btree_header.root_offset;
+    return __atomic_load_n(&btree_header.root_offset, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Retorna a ordem da árvore aberta
+ */
+int btree_get_order() {
+    return btree_order;
 }
\ No newline at end of file
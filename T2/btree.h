@@ -5,13 +5,35 @@
 #include <stdlib.h>
 #include <string.h>
 
-#define MAX_NAME_LEN 50
-#define ORDER 3
-#define MAX_KEYS (ORDER - 1)
-#define MIN_KEYS (ORDER / 2)
+#define MAX_NAME_LEN 256
 
+// Página do btree.dat: o nó ocupa uma página inteira (alterável com -DBTREE_PAGE_SIZE=8192,
+// até 64 KiB: as posições dentro da página têm 16 bits)
+#ifndef BTREE_PAGE_SIZE
+#define BTREE_PAGE_SIZE 4096
+#endif
+
+#define BTREE_MAGIC "BTREEIDX"
+#define BTREE_VERSION 6
+#define BTREE_MIN_ORDER 4
+#define BTREE_POOL_FRAMES 256
+#define BTREE_WAL_FILE "btree.wal"
+#define BTREE_BLOOM_FILE "btree.bloom"
+#define BTREE_NAMES_FILE "btree.names"
+#define BTREE_TEMP_FILE "btree.tmp"
+#define BTREE_DATA_FILE "image_data.dat"
+#define BTREE_DATA_TEMP_FILE "data_temp.dat"
+#define BTREE_BLOOM_FP 0.01
+#define BTREE_BLOOM_MAX_BYTES (64L * 1024 * 1024)
+#define BTREE_DEFAULT_FILL 90
+#define BTREE_OPTIMISTIC_TRIES 3
+#define BTREE_PAGE_FREE -1
+
+// Na árvore a chave é só (name_id, limiar) em 64 bits; o nome vem do
+// dicionário (btree.names) e é traduzido na entrada e na saída da interface
 typedef struct {
     char name[MAX_NAME_LEN];
+    unsigned int name_id;
     int threshold;
     long data_offset;
     int data_size;
@@ -19,27 +41,101 @@ typedef struct {
     int height;
 } BTreeKey;
 
+// Página de nó com slots: o vetor de slots cresce do início da área de dados
+// e os registros (dados da imagem ou filho) do fim para o início. O slot
+// guarda a chave inteira, então a busca binária no nó compara só inteiros
+typedef struct {
+    unsigned long long key;     // (name_id << 32) | limiar com o bit de sinal invertido
+    unsigned short offset;      // registro na área de dados
+    unsigned short reserved[3];
+} BTreeSlot;
+
+#define BTREE_NODE_FIXED (2 * sizeof(int) + 3 * sizeof(long) + 4 * sizeof(unsigned short))
+#define BTREE_NODE_SPACE ((int)(BTREE_PAGE_SIZE - BTREE_NODE_FIXED))
+#define BTREE_LEAF_VALUE ((int)(sizeof(long) + 3 * sizeof(int)))
+
+// Espaço de uma chave na folha (slot + registro); limita a ordem
+#define BTREE_ENTRY_SIZE ((int)sizeof(BTreeSlot) + BTREE_LEAF_VALUE)
+#define BTREE_MAX_ORDER (BTREE_NODE_SPACE / BTREE_ENTRY_SIZE + 1)
+
+// Árvore-B+: dados (offset, tamanho, dimensões) só nas folhas; nós internos
+// guardam apenas separadores (id do nome + limiar) e as folhas formam uma lista ligada
+// Nó interno: o filho i + 1 fica no registro da chave i e o primeiro em first_child
+// Página liberada: is_leaf = BTREE_PAGE_FREE e next_leaf aponta a próxima livre
 typedef struct {
     int is_leaf;
     int num_keys;
-    long children[ORDER];
-    BTreeKey keys[MAX_KEYS];
     long self_offset;
+    long next_leaf;
+    long first_child;
+    unsigned short heap_start;      // início dos registros
+    unsigned short garbage;         // bytes de registros removidos (recuperados ao compactar)
+    unsigned short reserved[2];
+    unsigned char data[BTREE_NODE_SPACE];
 } BTreeNode;
 
+// Cabeçalho gravado na página 0 (campos novos devem valer 0 por padrão)
 typedef struct {
+    char magic[8];
+    int version;
+    int page_size;
+    int order;
+    int node_count;
     long root_offset;
     long free_offset;
-    int node_count;
+    long free_list_head;
+    int free_count;
+    long bloom_stamp;   // checkpoint em que o btree.bloom foi gravado
+    int name_count;     // nomes do btree.names que o índice pode usar
+    int data_moving;    // compactação do arquivo de dados em andamento
 } BTreeHeader;
 
+// Cursor para varredura ordenada pelas folhas encadeadas
+// Entre chamadas a folha fica só fixada (sem trava); se outra thread alterar a
+// folha (versão diferente), o cursor se reposiciona a partir da última chave
+typedef struct {
+    BTreeNode* leaf;
+    int index;
+    unsigned long version;
+    BTreeKey last;      // última chave devolvida (ou a chave do btree_seek)
+    int has_last;       // 1 = continuar depois de last; 0 = a partir de last
+} BTreeCursor;
+
 // Interface pública da Árvore-B
+// Busca, cursores, inserção e remoção podem ser chamados de várias threads;
+// init, close, carga em lote e compactação exigem que nenhuma outra esteja usando
+void btree_set_order(int order);
+void btree_set_wal_group(int group_size);
+void btree_set_mmap(int enabled);
+void btree_set_bloom(double fp_rate, long max_bytes);
+int btree_is_read_only();
 void btree_init();
+void btree_flush();
+void btree_sync();
+void btree_close();
 void btree_insert(BTreeKey key);
+int btree_insert_batch(BTreeKey* keys, int count);
+int btree_bulk_load(BTreeKey* keys, int count, int fill_percent);
+int btree_vacuum(int fill_percent);
+int btree_relocate_data();
 void btree_delete(const char* name, int threshold);
 int btree_search(const char* name, int threshold, BTreeKey* result);
 void btree_print_inorder();
 void btree_print_pages();
 long btree_get_root_offset();
+int btree_get_order();
+
+// Varredura por intervalo (cursor)
+int btree_seek(BTreeCursor* cursor, const char* name, int threshold);
+int btree_next(BTreeCursor* cursor, BTreeKey* key);
+void btree_cursor_update(BTreeCursor* cursor, const BTreeKey* key);
+void btree_cursor_close(BTreeCursor* cursor);
+
+// Acesso às páginas (via pool de buffers); btree_read_node trava para leitura
+BTreeNode* btree_read_node(long offset);
+void btree_write_node(long offset, BTreeNode* node);
+void btree_release_node(BTreeNode* node);
+void btree_node_key(const BTreeNode* node, int index, BTreeKey* key);
+long btree_node_child(const BTreeNode* node, int index);
 
 #endif
\ No newline at end of file
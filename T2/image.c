@@ -1,237 +1,988 @@
 #include "image.h"
+#include "names.h"
+#include "simd.h"
 #include <ctype.h>
+#include <limits.h>
+#include <stdint.h>
+
+// Tamanho dos blocos lidos do arquivo PGM
+#define IMAGE_READ_BLOCK 65536
+
+// Leitor em blocos do PGM (linha atual e seu início no arquivo, para erros)
+typedef struct {
+    FILE* file;
+    unsigned char buffer[IMAGE_READ_BLOCK];
+    int position;
+    int length;
+    long block_offset;  // posição no arquivo do início do bloco
+    long line_start;    // posição no arquivo do início da linha atual
+    int line;
+} PGMReader;
+
+// Buffer do escritor de PGM
+#define IMAGE_WRITE_BLOCK 65536
+
+// Escritor em blocos: linhas formatadas no buffer, gravado de uma vez
+typedef struct {
+    FILE* file;
+    unsigned char buffer[IMAGE_WRITE_BLOCK];
+    int length;
+    int failed;
+} PGMWriter;
+
+// Dois dígitos decimais por entrada ("00" a "99")
+static const char image_digit_pairs[201] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+// Sequências binárias já formatadas em P2 ("0 0 0 ..." e "1 1 1 ...")
+#define IMAGE_RUN_PAIRS 256
+static unsigned char image_run_patterns[2][2 * IMAGE_RUN_PAIRS];
+
+// Formatos do registro RLE no arquivo de dados
+// Antigo: [primeiro valor (0 ou 1), contagens de até 255...]; uma contagem de
+// 255 seguida de outra é ambígua (mesmo valor ou alternância)
+// Versão 2: [IMAGE_RLE_VARINT, primeiro valor, sequências em LEB128...], cada
+// sequência inteira (sem limite) e o valor sempre alterna
+#define IMAGE_RLE_VARINT 2
+
+// Bytes de uma contagem de 64 bits em LEB128
+#define IMAGE_VARINT_MAX 10
+
+// Codificador RLE incremental: a sequência atual continua de uma linha para
+// a outra; cada linha acrescenta no máximo width + IMAGE_VARINT_MAX bytes
+typedef struct {
+    unsigned char* data;
+    long length;
+    int value;
+    unsigned long long count;
+} RLEEncoder;
+
+// Leitor das sequências de um registro (formato antigo ou LEB128); value é o
+// valor da próxima sequência
+typedef struct {
+    const unsigned char* data;
+    int size;
+    int index;
+    int varint;
+    int value;
+} RLEReader;
+
+// Saída RLE de um limiar na codificação de vários limiares numa passada:
+// a sequência atual começa em start (posição do pixel na imagem)
+typedef struct {
+    unsigned char* data;
+    size_t size;
+    size_t capacity;
+    size_t start;
+} RLEStream;
+
+// Chave coletada pela listagem (o nome vem do dicionário pelo id)
+typedef struct {
+    unsigned int name_id;
+    int threshold;
+    int width;
+    int height;
+    int data_size;
+} ImageListEntry;
 
 // Funções privadas
-static unsigned char* image_compress_rle(int** pixels, int width, int height, int* size);
-static int** image_decompress_rle(unsigned char* data, int size, int width, int height);
-static void database_compact_recursive(long node_offset, FILE* old_data, FILE* new_data);
+static int image_reader_fill(PGMReader* reader);
+static int image_read_number(PGMReader* reader, int* value);
+static int image_read_raw(PGMReader* reader, void* dest, size_t count);
+static void image_reader_error(const PGMReader* reader, const char* filename, const char* message);
+static int image_read_ascii_row(PGMReader* reader, PGMImage* img, int row);
+static int image_read_binary_row(PGMReader* reader, PGMImage* img, int row);
+static int image_read_header(PGMReader* reader, const char* filename, PGMImage* header);
+static int image_read_row(PGMReader* reader, const char* filename, PGMImage* img, int row, int file_row);
+static int image_write_rle(const char* filename, const unsigned char* data, int size, int width, int height, int format);
+static int image_writer_open(PGMWriter* writer, const char* filename);
+static void image_writer_flush(PGMWriter* writer);
+static unsigned char* image_writer_reserve(PGMWriter* writer, int count);
+static int image_writer_close(PGMWriter* writer, const char* filename);
+static void image_write_header(PGMWriter* writer, int format, int width, int height, int max_gray);
+static void image_write_sample(PGMWriter* writer, int value);
+static void image_pack_bit_row(unsigned char* out, const unsigned char* row, int width);
+static int image_compress_stream(const char* filename, int threshold, FILE* output, int* width, int* height, int* size);
+static void image_rle_start(RLEEncoder* encoder, unsigned char* data, int first_pixel);
+static void image_rle_encode_row(RLEEncoder* encoder, const unsigned long long* row, int width);
+static int image_put_varint(unsigned char* out, unsigned long long value);
+static void image_rle_reader_start(RLEReader* reader, const unsigned char* data, int size);
+static int image_rle_next(RLEReader* reader, unsigned long long* length, int* value);
+static int image_popcount(unsigned long long word);
+static int image_lowest_bit(unsigned long long word);
+static int image_compress_rle_multi(const PGMImage* img, const int thresholds[], int count, RLEStream streams[]);
+static int image_rle_put_run(RLEStream* stream, size_t length);
 
 /**
- * Lê arquivo PGM (formato P2 ASCII)
+ * Cria imagem zerada num único bloco (estrutura + pixels, buffer alinhado
+ * em IMAGE_ALIGN); NULL se as dimensões são inválidas ou falta memória
+ */
+PGMImage* image_create(int width, int height, int max_gray) {
+    if (width <= 0 || height <= 0 || max_gray <= 0 || max_gray > 65535) return NULL;
+    
+    int sample_bytes = max_gray > 255 ? 2 : 1;
+    size_t stride = ((size_t)width * sample_bytes + IMAGE_ALIGN - 1) & ~(size_t)(IMAGE_ALIGN - 1);
+    if (stride > INT_MAX || (size_t)height > ((size_t)-1 - sizeof(PGMImage) - IMAGE_ALIGN) / stride) return NULL;
+    
+    PGMImage* img = calloc(1, sizeof(PGMImage) + IMAGE_ALIGN + stride * height);
+    if (!img) return NULL;
+    
+    img->width = width;
+    img->height = height;
+    img->max_gray = max_gray;
+    img->binary = 0;
+    img->sample_bytes = sample_bytes;
+    img->stride = (int)stride;
+    img->data = (unsigned char*)(((uintptr_t)(img + 1) + IMAGE_ALIGN - 1) & ~(uintptr_t)(IMAGE_ALIGN - 1));
+    return img;
+}
+
+/**
+ * Lê arquivo PGM: P2 (ASCII) ou P5 (binário, 8 ou 16 bits por amostra)
+ * Lido em blocos; erros de formato informam linha e coluna
  */
 PGMImage* image_read_pgm(const char* filename) {
-    FILE* file = fopen(filename, "r");
-    if (!file) {
-        fprintf(stderr, "Erro: Não foi possível abrir %s\n", filename);
+    PGMReader reader;
+    PGMImage header;
+    if (!image_read_header(&reader, filename, &header)) return NULL;
+    
+    PGMImage* img = image_create(header.width, header.height, header.max_gray);
+    if (!img) {
+        fprintf(stderr, "Erro: Falha na alocação de memória\n");
+        fclose(reader.file);
         return NULL;
     }
+    img->binary = header.binary;
     
-    char magic[3];
-    if (fscanf(file, "%2s", magic) != 1 || strcmp(magic, "P2") != 0) {
-        fprintf(stderr, "Erro: Formato não é PGM P2\n");
-        fclose(file);
-        return NULL;
+    for (int i = 0; i < img->height; i++) {
+        if (!image_read_row(&reader, filename, img, i, i)) {
+            image_free(img);
+            fclose(reader.file);
+            return NULL;
+        }
     }
     
-    // Pular comentários
-    int c;
-    while ((c = fgetc(file)) == ' ' || c == '\t' || c == '\n');
-    if (c == '#') {
-        while ((c = fgetc(file)) != '\n' && c != EOF);
-    } else {
-        ungetc(c, file);
+    fclose(reader.file);
+    return img;
+}
+
+/**
+ * Abre o arquivo e lê o cabeçalho até o início das amostras; header recebe
+ * dimensões, max_gray e formato (sem pixels). 0 em erro (arquivo já fechado)
+ */
+static int image_read_header(PGMReader* reader, const char* filename, PGMImage* header) {
+    reader->file = fopen(filename, "rb");
+    if (!reader->file) {
+        fprintf(stderr, "Erro: Não foi possível abrir %s\n", filename);
+        return 0;
     }
+    // Blocos grandes: sem o buffer do stdio não há cópia extra
+    setvbuf(reader->file, NULL, _IONBF, 0);
+    reader->position = reader->length = 0;
+    reader->block_offset = reader->line_start = 0;
+    reader->line = 1;
     
-    PGMImage* img = malloc(sizeof(PGMImage));
-    if (!img) {
-        fclose(file);
-        return NULL;
+    int magic = (image_reader_fill(reader) && reader->length >= 2 && reader->buffer[0] == 'P') ? reader->buffer[1] : 0;
+    if (magic != '2' && magic != '5') {
+        fprintf(stderr, "Erro: Formato não é PGM P2 ou P5\n");
+        fclose(reader->file);
+        return 0;
     }
+    reader->position = 2;
     
-    if (fscanf(file, "%d %d %d", &img->width, &img->height, &img->max_gray) != 3) {
+    int width, height, max_gray;
+    unsigned char separator;
+    if (!image_read_number(reader, &width) || !image_read_number(reader, &height) ||
+        !image_read_number(reader, &max_gray) ||
+        (magic == '5' && (!image_read_raw(reader, &separator, 1) || !isspace(separator)))) {   // P5: um espaço antes das amostras
+        image_reader_error(reader, filename, "cabeçalho PGM inválido");
+        fclose(reader->file);
+        return 0;
+    }
+    if (width <= 0 || height <= 0 || max_gray <= 0 || max_gray > 65535) {
         fprintf(stderr, "Erro: Cabeçalho PGM inválido\n");
-        free(img);
-        fclose(file);
-        return NULL;
+        fclose(reader->file);
+        return 0;
     }
     
-    img->pixels = malloc(img->height * sizeof(int*));
-    if (!img->pixels) {
-        fprintf(stderr, "Erro: Falha na alocação de memória\n");
-        free(img);
-        fclose(file);
-        return NULL;
+    memset(header, 0, sizeof(PGMImage));
+    header->width = width;
+    header->height = height;
+    header->max_gray = max_gray;
+    header->binary = (magic == '5');
+    header->sample_bytes = max_gray > 255 ? 2 : 1;
+    return 1;
+}
+
+/**
+ * Lê a linha file_row do arquivo na linha row da imagem (informa o erro)
+ */
+static int image_read_row(PGMReader* reader, const char* filename, PGMImage* img, int row, int file_row) {
+    if (img->binary) {
+        if (image_read_binary_row(reader, img, row)) return 1;
+        fprintf(stderr, "Erro: Leitura de pixels falhou na linha %d\n", file_row);
+    } else {
+        if (image_read_ascii_row(reader, img, row)) return 1;
+        image_reader_error(reader, filename, "amostra inválida, ausente ou maior que max_gray");
     }
+    return 0;
+}
+
+/**
+ * Lê o próximo bloco do arquivo (0 no fim)
+ */
+static int image_reader_fill(PGMReader* reader) {
+    reader->block_offset += reader->length;
+    reader->position = 0;
+    reader->length = (int)fread(reader->buffer, 1, IMAGE_READ_BLOCK, reader->file);
+    return reader->length > 0;
+}
+
+/**
+ * Lê um número decimal sem sinal, pulando antes espaços e comentários (#)
+ * Retorna 0 se não há número ou ele tem dígitos demais (o leitor para no
+ * caractere problemático)
+ */
+static int image_read_number(PGMReader* reader, int* value) {
+    unsigned char c = 0;
     
-    for (int i = 0; i < img->height; i++) {
-        img->pixels[i] = malloc(img->width * sizeof(int));
-        if (!img->pixels[i]) {
-            fprintf(stderr, "Erro: Falha na alocação de linha %d\n", i);
-            for (int j = 0; j < i; j++) free(img->pixels[j]);
-            free(img->pixels);
-            free(img);
-            fclose(file);
-            return NULL;
-        }
-        
-        for (int j = 0; j < img->width; j++) {
-            if (fscanf(file, "%d", &img->pixels[i][j]) != 1) {
-                fprintf(stderr, "Erro: Leitura de pixels falhou em (%d,%d)\n", i, j);
-                for (int k = 0; k <= i; k++) free(img->pixels[k]);
-                free(img->pixels);
-                free(img);
-                fclose(file);
-                return NULL;
+    // Separadores: a linha só é contada nas quebras
+    for (;;) {
+        if (reader->position == reader->length && !image_reader_fill(reader)) return 0;
+        c = reader->buffer[reader->position];
+        if (c == '\n') {
+            reader->line++;
+            reader->line_start = reader->block_offset + reader->position + 1;
+        } else if (c == '#') {
+            while (c != '\n') {
+                if (++reader->position == reader->length && !image_reader_fill(reader)) return 0;
+                c = reader->buffer[reader->position];
             }
+            continue;
+        } else if (c != ' ' && c != '\t' && c != '\r' && c != '\v' && c != '\f') {
+            break;
         }
+        reader->position++;
     }
     
-    fclose(file);
-    return img;
+    if ((unsigned char)(c - '0') > 9) return 0;
+    
+    // Dígitos: laço apertado sobre o bloco
+    unsigned int number = 0;
+    int digits = 0;
+    for (;;) {
+        const unsigned char* p = reader->buffer + reader->position;
+        const unsigned char* end = reader->buffer + reader->length;
+        unsigned int digit;
+        while (p < end && (digit = (unsigned int)(*p - '0')) <= 9) {
+            number = number * 10 + digit;
+            p++;
+            digits++;
+        }
+        reader->position = (int)(p - reader->buffer);
+        if (p < end || !image_reader_fill(reader)) break;
+    }
+    
+    if (digits > 9) return 0;
+    *value = (int)number;
+    return 1;
 }
 
 /**
- * Escreve arquivo PGM
+ * Copia bytes brutos: o resto do bloco e depois direto do arquivo
  */
-int image_write_pgm(const char* filename, PGMImage* img) {
-    FILE* file = fopen(filename, "w");
-    if (!file) {
-        fprintf(stderr, "Erro: Não foi possível criar %s\n", filename);
-        return 0;
-    }
+static int image_read_raw(PGMReader* reader, void* dest, size_t count) {
+    size_t buffered = (size_t)(reader->length - reader->position);
+    if (buffered > count) buffered = count;
     
-    fprintf(file, "P2\n%d %d\n%d\n", img->width, img->height, img->max_gray);
+    memcpy(dest, reader->buffer + reader->position, buffered);
+    reader->position += (int)buffered;
+    if (buffered == count) return 1;
     
-    for (int i = 0; i < img->height; i++) {
+    size_t rest = count - buffered;
+    size_t got = fread((unsigned char*)dest + buffered, 1, rest, reader->file);
+    reader->block_offset += (long)got;
+    return got == rest;
+}
+
+/**
+ * Erro de formato com linha e coluna da posição atual
+ */
+static void image_reader_error(const PGMReader* reader, const char* filename, const char* message) {
+    long column = reader->block_offset + reader->position - reader->line_start + 1;
+    fprintf(stderr, "Erro: %s: %s (linha %d, coluna %ld)\n", filename, message, reader->line, column);
+}
+
+/**
+ * Lê uma linha P2 para o buffer da imagem
+ */
+static int image_read_ascii_row(PGMReader* reader, PGMImage* img, int row) {
+    int value;
+    if (img->sample_bytes == 1) {
+        unsigned char* out = IMAGE_ROW8(img, row);
         for (int j = 0; j < img->width; j++) {
-            fprintf(file, "%d", img->pixels[i][j]);
-            if (j < img->width - 1) fputc(' ', file);
+            if (!image_read_number(reader, &value) || value > img->max_gray) return 0;
+            out[j] = (unsigned char)value;
+        }
+    } else {
+        unsigned short* out = IMAGE_ROW16(img, row);
+        for (int j = 0; j < img->width; j++) {
+            if (!image_read_number(reader, &value) || value > img->max_gray) return 0;
+            out[j] = (unsigned short)value;
         }
-        fputc('\n', file);
     }
-    
-    fclose(file);
     return 1;
 }
 
 /**
- * Aplica limiarização para binarizar imagem
+ * Lê uma linha P5 direto no buffer da imagem (8 bits já é o formato final;
+ * 16 bits vem em big-endian e é convertido no lugar)
  */
-void image_binarize(PGMImage* img, int threshold) {
-    for (int i = 0; i < img->height; i++) {
+static int image_read_binary_row(PGMReader* reader, PGMImage* img, int row) {
+    unsigned char* bytes = IMAGE_ROW8(img, row);
+    if (!image_read_raw(reader, bytes, (size_t)img->width * img->sample_bytes)) return 0;
+    
+    if (img->sample_bytes == 2) {
+        unsigned short* out = IMAGE_ROW16(img, row);
         for (int j = 0; j < img->width; j++) {
-            img->pixels[i][j] = (img->pixels[i][j] > threshold) ? 1 : 0;
+            out[j] = (unsigned short)((bytes[2 * j] << 8) | bytes[2 * j + 1]);
         }
     }
-    img->max_gray = 1;
+    return 1;
 }
 
 /**
- * Libera memória da imagem
+ * Escreve arquivo PGM no formato em que foi lido (P5 se img->binary, senão P2)
  */
-void image_free(PGMImage* img) {
-    if (img) {
-        if (img->pixels) {
-            for (int i = 0; i < img->height; i++) {
-                free(img->pixels[i]);
+int image_write_pgm(const char* filename, PGMImage* img) {
+    return image_write_pgm_format(filename, img, img->binary ? IMAGE_FORMAT_P5 : IMAGE_FORMAT_P2);
+}
+
+/**
+ * Escreve a imagem no formato pedido: P2, P5 (16 bits se max_gray > 255)
+ * ou P4 (PBM, só imagens binárias), formatando as linhas num buffer grande
+ */
+int image_write_pgm_format(const char* filename, PGMImage* img, int format) {
+    if (format == IMAGE_FORMAT_P4 && img->max_gray != 1) {
+        fprintf(stderr, "Erro: P4 exige imagem binária (max_gray = 1)\n");
+        return 0;
+    }
+    
+    PGMWriter writer;
+    if (!image_writer_open(&writer, filename)) return 0;
+    image_write_header(&writer, format, img->width, img->height, img->max_gray);
+    
+    for (int i = 0; i < img->height; i++) {
+        if (img->sample_bytes == 2) {
+            const unsigned short* row = IMAGE_ROW16(img, i);
+            if (format == IMAGE_FORMAT_P5) {
+                unsigned char* out = image_writer_reserve(&writer, 2 * img->width);
+                for (int j = 0; j < img->width; j++) {
+                    out[2 * j] = (unsigned char)(row[j] >> 8);
+                    out[2 * j + 1] = (unsigned char)row[j];
+                }
+            } else {
+                for (int j = 0; j < img->width; j++) image_write_sample(&writer, row[j]);
+                writer.buffer[writer.length - 1] = '\n';
             }
-            free(img->pixels);
+            continue;
+        }
+        
+        const unsigned char* row = IMAGE_ROW8(img, i);
+        if (format == IMAGE_FORMAT_P4) {
+            image_pack_bit_row(image_writer_reserve(&writer, (img->width + 7) / 8), row, img->width);
+        } else if (format == IMAGE_FORMAT_P5) {
+            memcpy(image_writer_reserve(&writer, img->width), row, img->width);
+        } else {
+            for (int j = 0; j < img->width; j++) image_write_sample(&writer, row[j]);
+            writer.buffer[writer.length - 1] = '\n';
         }
-        free(img);
     }
+    
+    return image_writer_close(&writer, filename);
 }
 
 /**
- * Comprime imagem usando RLE
+ * Escreve imagem binária direto das sequências RLE, sem a matriz de pixels:
+ * cada sequência vira um bloco de "0 "/"1 " (P2), bytes (P5) ou bits (P4)
  */
-static unsigned char* image_compress_rle(int** pixels, int width, int height, int* size) {
-    int total = width * height;
-    unsigned char* compressed = malloc(total * 2);
-    if (!compressed) return NULL;
+static int image_write_rle(const char* filename, const unsigned char* data, int size, int width, int height, int format) {
+    if (size < 1 || width <= 0 || height <= 0) return 0;
     
-    int current_val = pixels[0][0];
-    int count = 1;
-    int index = 0;
+    PGMWriter writer;
+    if (!image_writer_open(&writer, filename)) return 0;
+    image_write_header(&writer, format, width, height, 1);
     
-    compressed[index++] = current_val;
+    // P4: linha de bits montada à parte (1 = preto = pixel 0)
+    int row_bytes = (width + 7) / 8;
+    unsigned char* bits = (format == IMAGE_FORMAT_P4) ? malloc(row_bytes) : NULL;
+    if (format == IMAGE_FORMAT_P4 && !bits) {
+        fclose(writer.file);
+        return 0;
+    }
+    
+    if (image_run_patterns[0][0] == 0) {
+        for (int j = 0; j < IMAGE_RUN_PAIRS; j++) {
+            image_run_patterns[0][2 * j] = '0';
+            image_run_patterns[1][2 * j] = '1';
+            image_run_patterns[0][2 * j + 1] = image_run_patterns[1][2 * j + 1] = ' ';
+        }
+    }
+    
+    // Sequências no formato antigo ou em LEB128; o valor alterna a cada uma
+    RLEReader runs;
+    image_rle_reader_start(&runs, data, size);
+    unsigned long long remaining = 0;
+    int value = 0;
     
     for (int i = 0; i < height; i++) {
-        for (int j = (i == 0 ? 1 : 0); j < width; j++) {
-            if (pixels[i][j] == current_val && count < 255) {
-                count++;
-            } else {
-                compressed[index++] = count;
-                current_val = pixels[i][j];
-                count = 1;
+        if (bits) memset(bits, 0, row_bytes);
+        int column = 0;
+        while (column < width) {
+            while (remaining == 0) {
+                if (!image_rle_next(&runs, &remaining, &value)) {
+                    // Dados curtos: completa com 0
+                    value = 0;
+                    remaining = (unsigned long long)width * height;
+                }
             }
+            
+            int span = (remaining < (unsigned long long)(width - column)) ? (int)remaining : width - column;
+            if (format == IMAGE_FORMAT_P2) {
+                for (int done = 0; done < span; ) {
+                    int chunk = (span - done < IMAGE_RUN_PAIRS) ? span - done : IMAGE_RUN_PAIRS;
+                    memcpy(image_writer_reserve(&writer, 2 * chunk), image_run_patterns[value], 2 * chunk);
+                    done += chunk;
+                }
+            } else if (format == IMAGE_FORMAT_P5) {
+                memset(image_writer_reserve(&writer, span), value, span);
+            } else if (!value) {
+                for (int j = column; j < column + span; j++) {
+                    bits[j >> 3] |= (unsigned char)(0x80 >> (j & 7));
+                }
+            }
+            column += span;
+            remaining -= span;
+        }
+        
+        if (format == IMAGE_FORMAT_P2) {
+            writer.buffer[writer.length - 1] = '\n';
+        } else if (bits) {
+            memcpy(image_writer_reserve(&writer, row_bytes), bits, row_bytes);
         }
     }
-    compressed[index++] = count;
     
-    *size = index;
-    return realloc(compressed, index);
+    free(bits);
+    return image_writer_close(&writer, filename);
 }
 
 /**
- * Descomprime dados RLE
+ * Prepara a leitura das sequências: registro que começa por IMAGE_RLE_VARINT
+ * está em LEB128, senão é o formato antigo
  */
-static int** image_decompress_rle(unsigned char* data, int size, int width, int height) {
-    int** pixels = malloc(height * sizeof(int*));
-    if (!pixels) return NULL;
+static void image_rle_reader_start(RLEReader* reader, const unsigned char* data, int size) {
+    reader->data = data;
+    reader->size = size;
+    reader->varint = (size > 0 && data[0] == IMAGE_RLE_VARINT);
+    reader->index = reader->varint ? 2 : 1;
+    reader->value = (size > reader->index - 1 && data[reader->index - 1]) ? 1 : 0;
+}
+
+/**
+ * Próxima sequência e seu valor; contagem 0 só alterna o valor (formato
+ * antigo). Retorna 0 no fim dos dados ou numa contagem truncada
+ */
+static int image_rle_next(RLEReader* reader, unsigned long long* length, int* value) {
+    if (reader->index >= reader->size) return 0;
     
-    for (int i = 0; i < height; i++) {
-        pixels[i] = malloc(width * sizeof(int));
-        if (!pixels[i]) {
-            for (int j = 0; j < i; j++) free(pixels[j]);
-            free(pixels);
-            return NULL;
+    if (reader->varint) {
+        unsigned long long count = 0;
+        int shift = 0;
+        unsigned char byte;
+        do {
+            if (reader->index >= reader->size || shift > 63) return 0;
+            byte = reader->data[reader->index++];
+            count |= (unsigned long long)(byte & 0x7F) << shift;
+            shift += 7;
+        } while (byte & 0x80);
+        *length = count;
+    } else {
+        *length = reader->data[reader->index++];
+    }
+    
+    *value = reader->value;
+    reader->value = !reader->value;
+    return 1;
+}
+
+/**
+ * Abre o arquivo sem o buffer do stdio (cada descarga é uma escrita)
+ */
+static int image_writer_open(PGMWriter* writer, const char* filename) {
+    writer->file = fopen(filename, "wb");
+    if (!writer->file) {
+        fprintf(stderr, "Erro: Não foi possível criar %s\n", filename);
+        return 0;
+    }
+    setvbuf(writer->file, NULL, _IONBF, 0);
+    writer->length = 0;
+    writer->failed = 0;
+    return 1;
+}
+
+/**
+ * Grava o conteúdo do buffer
+ */
+static void image_writer_flush(PGMWriter* writer) {
+    if (writer->length > 0 && fwrite(writer->buffer, 1, writer->length, writer->file) != (size_t)writer->length) {
+        writer->failed = 1;
+    }
+    writer->length = 0;
+}
+
+/**
+ * Reserva count bytes contíguos no buffer (count <= IMAGE_WRITE_BLOCK)
+ */
+static unsigned char* image_writer_reserve(PGMWriter* writer, int count) {
+    if (writer->length + count > IMAGE_WRITE_BLOCK) image_writer_flush(writer);
+    unsigned char* out = writer->buffer + writer->length;
+    writer->length += count;
+    return out;
+}
+
+/**
+ * Descarrega o resto e fecha (0 se alguma escrita falhou)
+ */
+static int image_writer_close(PGMWriter* writer, const char* filename) {
+    image_writer_flush(writer);
+    if (fclose(writer->file) != 0) writer->failed = 1;
+    if (writer->failed) fprintf(stderr, "Erro: Falha ao gravar %s\n", filename);
+    return !writer->failed;
+}
+
+/**
+ * Cabeçalho do formato (P4 não tem max_gray)
+ */
+static void image_write_header(PGMWriter* writer, int format, int width, int height, int max_gray) {
+    char header[64];
+    int length;
+    if (format == IMAGE_FORMAT_P4) {
+        length = snprintf(header, sizeof(header), "P4\n%d %d\n", width, height);
+    } else {
+        length = snprintf(header, sizeof(header), "P%d\n%d %d\n%d\n", format, width, height, max_gray);
+    }
+    memcpy(image_writer_reserve(writer, length), header, length);
+}
+
+/**
+ * Escreve a amostra (0 a 65535) e um espaço, dois dígitos por vez pela tabela
+ */
+static void image_write_sample(PGMWriter* writer, int value) {
+    unsigned char* out = image_writer_reserve(writer, 6);
+    unsigned char digits[6];
+    int count = 0;
+    unsigned int number = (unsigned int)value;
+    
+    while (number >= 100) {
+        const char* pair = image_digit_pairs + 2 * (number % 100);
+        digits[count++] = pair[1];
+        digits[count++] = pair[0];
+        number /= 100;
+    }
+    if (number >= 10) {
+        digits[count++] = image_digit_pairs[2 * number + 1];
+        digits[count++] = image_digit_pairs[2 * number];
+    } else {
+        digits[count++] = (unsigned char)('0' + number);
+    }
+    
+    for (int i = 0; i < count; i++) out[i] = digits[count - 1 - i];
+    out[count] = ' ';
+    writer->length -= 6 - (count + 1);
+}
+
+/**
+ * Empacota uma linha binária em bits, do mais para o menos significativo
+ * (PBM: 1 = preto, ou seja, pixel 0)
+ */
+static void image_pack_bit_row(unsigned char* out, const unsigned char* row, int width) {
+    for (int j = 0; j < width; j += 8) {
+        unsigned char byte = 0;
+        for (int bit = 0; bit < 8; bit++) {
+            byte <<= 1;
+            if (j + bit < width && row[j + bit] == 0) byte |= 1;
+        }
+        out[j / 8] = byte;
+    }
+}
+
+/**
+ * Aplica limiarização e devolve a imagem binária empacotada em bits (pixel
+ * > limiar vira 1); a imagem lida não é alterada. NULL se falta memória
+ */
+BinaryImage* image_binarize(const PGMImage* img, int threshold) {
+    BinaryImage* binary = image_create_binary(img->width, img->height);
+    if (!binary) return NULL;
+    
+    // Kernel vetorial grava as palavras da linha direto (simd.c)
+    for (int i = 0; i < img->height; i++) {
+        if (img->sample_bytes == 1) {
+            simd_binarize_row8(IMAGE_ROW8(img, i), img->width, threshold, IMAGE_BINARY_ROW(binary, i));
+        } else {
+            simd_binarize_row16(IMAGE_ROW16(img, i), img->width, threshold, IMAGE_BINARY_ROW(binary, i));
         }
     }
+    return binary;
+}
+
+/**
+ * Libera memória da imagem (estrutura e pixels são um bloco só)
+ */
+void image_free(PGMImage* img) {
+    free(img);
+}
+
+/**
+ * Cria imagem binária zerada (estrutura e bits num único bloco, bits
+ * alinhados em IMAGE_ALIGN); NULL se as dimensões são inválidas ou falta memória
+ */
+BinaryImage* image_create_binary(int width, int height) {
+    if (width <= 0 || height <= 0) return NULL;
+    
+    int words_per_row = (width + 63) / 64;
+    size_t row_bytes = (size_t)words_per_row * sizeof(unsigned long long);
+    if ((size_t)height > ((size_t)-1 - sizeof(BinaryImage) - IMAGE_ALIGN) / row_bytes) return NULL;
+    
+    BinaryImage* img = calloc(1, sizeof(BinaryImage) + IMAGE_ALIGN + row_bytes * height);
+    if (!img) return NULL;
     
-    int current_val = data[0];
-    int data_index = 1;
+    img->width = width;
+    img->height = height;
+    img->words_per_row = words_per_row;
+    img->bits = (unsigned long long*)(((uintptr_t)(img + 1) + IMAGE_ALIGN - 1) & ~(uintptr_t)(IMAGE_ALIGN - 1));
+    return img;
+}
+
+/**
+ * Quantidade de pixels 1 (brancos) da imagem binária, uma palavra por vez
+ */
+long image_count_white(const BinaryImage* img) {
+    long count = 0;
+    size_t words = (size_t)img->words_per_row * img->height;
+    for (size_t k = 0; k < words; k++) count += image_popcount(img->bits[k]);
+    return count;
+}
+
+/**
+ * Libera a imagem binária
+ */
+void image_free_binary(BinaryImage* img) {
+    free(img);
+}
+
+/**
+ * Quantidade de bits ligados na palavra
+ */
+static int image_popcount(unsigned long long word) {
+#if defined(__GNUC__)
+    return __builtin_popcountll(word);
+#else
     int count = 0;
+    while (word) {
+        word &= word - 1;
+        count++;
+    }
+    return count;
+#endif
+}
+
+/**
+ * Posição do bit ligado mais baixo (tzcnt; a palavra não pode ser 0)
+ */
+static int image_lowest_bit(unsigned long long word) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(word);
+#else
+    int position = 0;
+    while (!(word & 1)) {
+        word >>= 1;
+        position++;
+    }
+    return position;
+#endif
+}
+
+/**
+ * Lê, limiariza e comprime o PGM linha a linha, gravando o RLE direto em
+ * output: memória O(largura), qualquer que seja a altura da imagem.
+ * Retorna 0 em erro (bytes já gravados ficam sem chave no índice e somem
+ * na compactação do arquivo de dados)
+ */
+static int image_compress_stream(const char* filename, int threshold, FILE* output, int* width, int* height, int* size) {
+    PGMReader reader;
+    PGMImage header;
+    if (!image_read_header(&reader, filename, &header)) return 0;
     
-    for (int i = 0; i < height; i++) {
-        for (int j = 0; j < width; j++) {
-            if (count == 0) {
-                if (data_index >= size) break;
-                count = data[data_index++];
-            }
-            pixels[i][j] = current_val;
-            count--;
-            if (count == 0) {
-                current_val = !current_val;
-            }
+    // Uma linha de amostras, uma de bits e o buffer de saída
+    PGMImage* row = image_create(header.width, 1, header.max_gray);
+    BinaryImage* bits = image_create_binary(header.width, 1);
+    unsigned char* out = malloc((size_t)header.width + 2 + 2 * IMAGE_VARINT_MAX + IMAGE_WRITE_BLOCK);
+    if (!row || !bits || !out) {
+        fprintf(stderr, "Erro: Falha na alocação de memória\n");
+        image_free(row);
+        image_free_binary(bits);
+        free(out);
+        fclose(reader.file);
+        return 0;
+    }
+    row->binary = header.binary;
+    
+    RLEEncoder encoder = { out, 0, 0, 0 };
+    long written = 0;
+    int ok = 1;
+    
+    for (int i = 0; i < header.height && ok; i++) {
+        if (!image_read_row(&reader, filename, row, 0, i)) {
+            ok = 0;
+            break;
+        }
+        if (row->sample_bytes == 1) {
+            simd_binarize_row8(IMAGE_ROW8(row, 0), header.width, threshold, bits->bits);
+        } else {
+            simd_binarize_row16(IMAGE_ROW16(row, 0), header.width, threshold, bits->bits);
+        }
+        
+        if (i == 0) image_rle_start(&encoder, out, (int)(bits->bits[0] & 1));
+        image_rle_encode_row(&encoder, bits->bits, header.width);
+        
+        // Buffer cheio: grava e recomeça (a sequência atual continua aberta)
+        if (encoder.length >= IMAGE_WRITE_BLOCK) {
+            ok = fwrite(out, 1, encoder.length, output) == (size_t)encoder.length;
+            written += encoder.length;
+            encoder.length = 0;
         }
     }
     
-    return pixels;
+    if (ok) {
+        encoder.length += image_put_varint(out + encoder.length, encoder.count);
+        ok = fwrite(out, 1, encoder.length, output) == (size_t)encoder.length;
+        written += encoder.length;
+        if (!ok) fprintf(stderr, "Erro: Falha ao gravar os dados comprimidos\n");
+    }
+    if (ok && written > INT_MAX) {
+        fprintf(stderr, "Erro: Dados comprimidos maiores que o índice suporta\n");
+        ok = 0;
+    }
+    
+    if (ok) {
+        *width = header.width;
+        *height = header.height;
+        *size = (int)written;
+    }
+    
+    image_free(row);
+    image_free_binary(bits);
+    free(out);
+    fclose(reader.file);
+    return ok;
 }
 
 /**
- * Adiciona imagem com único limiar
+ * Inicia o RLE em data: versão do formato e valor do primeiro pixel
  */
-void database_add_image(const char* filename, int threshold) {
-    printf("Processando imagem: %s (limiar=%d)\n", filename, threshold);
+static void image_rle_start(RLEEncoder* encoder, unsigned char* data, int first_pixel) {
+    encoder->data = data;
+    encoder->data[0] = IMAGE_RLE_VARINT;
+    encoder->data[1] = (unsigned char)first_pixel;
+    encoder->length = 2;
+    encoder->value = first_pixel;
+    encoder->count = 0;
+}
+
+/**
+ * Acrescenta as sequências de uma linha de bits (tamanho inteiro em LEB128),
+ * uma palavra por vez: o XOR com o valor atual liga os pixels que diferem
+ * dele e o bit mais baixo ligado é a próxima troca; palavra toda igual ao
+ * valor atual (só 0 ou só 1) soma 64 pixels num passo
+ */
+static void image_rle_encode_row(RLEEncoder* encoder, const unsigned long long* row, int width) {
+    int current_val = encoder->value;
+    unsigned long long count = encoder->count;
+    long length = encoder->length;
+    int words = (width + 63) / 64;
     
-    PGMImage* img = image_read_pgm(filename);
-    if (!img) {
-        printf("Erro: Falha ao ler imagem %s\n", filename);
-        return;
+    for (int k = 0; k < words; k++) {
+        int bits = (k == words - 1 && width % 64) ? width % 64 : 64;
+        unsigned long long valid = (bits == 64) ? ~0ULL : (1ULL << bits) - 1;
+        unsigned long long word = row[k];
+        unsigned long long differ = (word ^ (current_val ? ~0ULL : 0)) & valid;
+        int position = 0;
+        
+        while (differ) {
+            int boundary = image_lowest_bit(differ);
+            count += boundary - position;
+            length += image_put_varint(encoder->data + length, count);
+            current_val = !current_val;
+            count = 0;
+            position = boundary;
+            differ = (word ^ (current_val ? ~0ULL : 0)) & valid & (~0ULL << boundary);
+        }
+        count += bits - position;
     }
     
-    image_binarize(img, threshold);
+    encoder->value = current_val;
+    encoder->count = count;
+    encoder->length = length;
+}
+
+/**
+ * Grava value em LEB128 (7 bits por byte, bit alto = continua); retorna os
+ * bytes usados
+ */
+static int image_put_varint(unsigned char* out, unsigned long long value) {
+    int length = 0;
+    while (value >= 0x80) {
+        out[length++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    out[length++] = (unsigned char)value;
+    return length;
+}
+
+/**
+ * Comprime a imagem em tons de cinza para vários limiares numa única
+ * passada, sem binarizar cópias: streams[i] recebe o RLE de thresholds[i],
+ * igual ao de image_rle_encode_row sobre a imagem binarizada.
+ * Com os limiares ordenados, o pixel v é 1 exatamente nos level[v]
+ * primeiros (level[v] = limiares abaixo de v); só mudam de valor as
+ * saídas entre o nível do pixel anterior e o do atual.
+ * Retorna 0 se falta memória (as saídas já alocadas ficam com o chamador)
+ */
+static int image_compress_rle_multi(const PGMImage* img, const int thresholds[], int count, RLEStream streams[]) {
+    int values = img->sample_bytes == 1 ? 256 : 65536;
+    int* order = malloc(count * sizeof(int));
+    int* level = malloc(values * sizeof(int));
+    RLEStream** sorted = malloc(count * sizeof(RLEStream*));
+    if (!order || !level || !sorted) {
+        free(order);
+        free(level);
+        free(sorted);
+        return 0;
+    }
     
-    int compressed_size;
-    unsigned char* compressed = image_compress_rle(img->pixels, img->width, img->height, &compressed_size);
-    if (!compressed) {
-        printf("Erro: Falha na compressão da imagem\n");
-        image_free(img);
+    // Limiares em ordem crescente (inserção: a lista é curta)
+    for (int i = 0; i < count; i++) {
+        int j = i;
+        while (j > 0 && thresholds[order[j - 1]] > thresholds[i]) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+    for (int k = 0; k < count; k++) sorted[k] = &streams[order[k]];
+    
+    for (int v = 0, below = 0; v < values; v++) {
+        while (below < count && thresholds[order[below]] < v) below++;
+        level[v] = below;
+    }
+    
+    size_t total = (size_t)img->width * img->height;
+    int ok = 1;
+    int previous = img->sample_bytes == 1 ? level[IMAGE_ROW8(img, 0)[0]] : level[IMAGE_ROW16(img, 0)[0]];
+    
+    for (int k = 0; k < count; k++) {
+        RLEStream* stream = sorted[k];
+        stream->capacity = total / 64 + 16;
+        stream->data = malloc(stream->capacity);
+        stream->size = 0;
+        stream->start = 0;
+        if (!stream->data) {
+            ok = 0;
+        } else {
+            stream->data[stream->size++] = IMAGE_RLE_VARINT;
+            stream->data[stream->size++] = k < previous;
+        }
+    }
+    
+    size_t position = 0;
+    for (int i = 0; i < img->height && ok; i++) {
+        const unsigned char* row8 = IMAGE_ROW8(img, i);
+        const unsigned short* row16 = IMAGE_ROW16(img, i);
+        for (int j = 0; j < img->width; j++, position++) {
+            int current = img->sample_bytes == 1 ? level[row8[j]] : level[row16[j]];
+            if (current == previous) continue;
+            
+            // Limiares entre os dois níveis trocam de valor neste pixel
+            int low = current < previous ? current : previous;
+            int high = current < previous ? previous : current;
+            for (int k = low; k < high && ok; k++) {
+                RLEStream* stream = sorted[k];
+                size_t length = position - stream->start;
+                if (length < 0x80 && stream->size < stream->capacity) {
+                    stream->data[stream->size++] = (unsigned char)length;
+                } else {
+                    ok = image_rle_put_run(stream, length);
+                }
+                stream->start = position;
+            }
+            previous = current;
+        }
+    }
+    for (int k = 0; k < count && ok; k++) ok = image_rle_put_run(sorted[k], total - sorted[k]->start);
+    
+    free(order);
+    free(level);
+    free(sorted);
+    return ok;
+}
+
+/**
+ * Grava o tamanho de uma sequência em LEB128, aumentando a saída se preciso
+ */
+static int image_rle_put_run(RLEStream* stream, size_t length) {
+    size_t needed = stream->size + IMAGE_VARINT_MAX;
+    if (needed > stream->capacity) {
+        size_t capacity = stream->capacity * 2 > needed ? stream->capacity * 2 : needed;
+        unsigned char* data = realloc(stream->data, capacity);
+        if (!data) return 0;
+        stream->data = data;
+        stream->capacity = capacity;
+    }
+    
+    stream->size += image_put_varint(stream->data + stream->size, length);
+    return 1;
+}
+
+/**
+ * Adiciona imagem com único limiar (lida, limiarizada e comprimida linha a
+ * linha, sem a imagem inteira na memória)
+ */
+void database_add_image(const char* filename, int threshold) {
+    if (btree_is_read_only()) {
+        printf("Erro: Índice aberto somente para leitura\n");
         return;
     }
     
+    printf("Processando imagem: %s (limiar=%d)\n", filename, threshold);
+    
     FILE* data_file = fopen("image_data.dat", "ab");
     if (!data_file) {
         printf("Erro: Não foi possível abrir arquivo de dados\n");
-        free(compressed);
-        image_free(img);
         return;
     }
     
     long offset = ftell(data_file);
-    fwrite(compressed, 1, compressed_size, data_file);
+    int width, height, compressed_size;
+    int compressed = image_compress_stream(filename, threshold, data_file, &width, &height, &compressed_size);
     fclose(data_file);
+    if (!compressed) {
+        printf("Erro: Falha ao ler ou comprimir imagem %s\n", filename);
+        return;
+    }
     
     BTreeKey key;
     strncpy(key.name, filename, MAX_NAME_LEN - 1);
@@ -239,21 +990,25 @@ void database_add_image(const char* filename, int threshold) {
     key.threshold = threshold;
     key.data_offset = offset;
     key.data_size = compressed_size;
-    key.width = img->width;
-    key.height = img->height;
+    key.width = width;
+    key.height = height;
     
     btree_insert(key);
-    
-    free(compressed);
-    image_free(img);
+    btree_sync();
     
     printf("Imagem adicionada com sucesso\n");
 }
 
 /**
- * Adiciona imagem com múltiplos limiares
+ * Adiciona imagem com múltiplos limiares (todos codificados numa única
+ * passada sobre a imagem lida)
  */
 void database_add_multiple_thresholds(const char* filename, int thresholds[], int count) {
+    if (btree_is_read_only()) {
+        printf("Erro: Índice aberto somente para leitura\n");
+        return;
+    }
+    
     printf("\n=== PROCESSANDO %d VERSÕES DE %s ===\n", count, filename);
     
     PGMImage* original = image_read_pgm(filename);
@@ -262,77 +1017,59 @@ void database_add_multiple_thresholds(const char* filename, int thresholds[], in
         return;
     }
     
+    // Chaves de todas as versões vão para o índice juntas (mesmo nome,
+    // folhas vizinhas): uma descida por folha em vez de uma por limiar
+    BTreeKey* keys = malloc(count * sizeof(BTreeKey));
+    RLEStream* streams = calloc(count, sizeof(RLEStream));
+    if (!keys || !streams) {
+        printf("Erro de alocação\n");
+        free(keys);
+        free(streams);
+        image_free(original);
+        return;
+    }
+    
+    FILE* data_file = NULL;
+    if (!image_compress_rle_multi(original, thresholds, count, streams)) {
+        printf("Erro na compressão\n");
+    } else if (!(data_file = fopen("image_data.dat", "ab"))) {
+        printf("Erro ao abrir arquivo\n");
+    }
+    if (!data_file) {
+        for (int i = 0; i < count; i++) free(streams[i].data);
+        free(streams);
+        free(keys);
+        image_free(original);
+        return;
+    }
+    
     for (int i = 0; i < count; i++) {
         printf("  Versão %d/%d: limiar=%d... ", i + 1, count, thresholds[i]);
         
-        PGMImage* copy = malloc(sizeof(PGMImage));
-        if (!copy) {
-            printf("Erro de alocação\n");
-            continue;
-        }
-        
-        copy->width = original->width;
-        copy->height = original->height;
-        copy->max_gray = original->max_gray;
-        
-        copy->pixels = malloc(copy->height * sizeof(int*));
-        if (!copy->pixels) {
-            printf("Erro de alocação\n");
-            free(copy);
-            continue;
-        }
-        
-        for (int row = 0; row < copy->height; row++) {
-            copy->pixels[row] = malloc(copy->width * sizeof(int));
-            if (!copy->pixels[row]) {
-                printf("Erro de alocação\n");
-                for (int k = 0; k < row; k++) free(copy->pixels[k]);
-                free(copy->pixels);
-                free(copy);
-                continue;
-            }
-            memcpy(copy->pixels[row], original->pixels[row], copy->width * sizeof(int));
-        }
-        
-        image_binarize(copy, thresholds[i]);
-        
-        int compressed_size;
-        unsigned char* compressed = image_compress_rle(copy->pixels, copy->width, copy->height, &compressed_size);
-        if (!compressed) {
-            printf("Erro na compressão\n");
-            image_free(copy);
-            continue;
-        }
-        
-        FILE* data_file = fopen("image_data.dat", "ab");
-        if (!data_file) {
-            printf("Erro ao abrir arquivo\n");
-            free(compressed);
-            image_free(copy);
-            continue;
-        }
-        
         long offset = ftell(data_file);
-        fwrite(compressed, 1, compressed_size, data_file);
-        fclose(data_file);
+        fwrite(streams[i].data, 1, streams[i].size, data_file);
         
-        BTreeKey key;
-        strncpy(key.name, filename, MAX_NAME_LEN - 1);
-        key.name[MAX_NAME_LEN - 1] = '\0';
-        key.threshold = thresholds[i];
-        key.data_offset = offset;
-        key.data_size = compressed_size;
-        key.width = copy->width;
-        key.height = copy->height;
+        BTreeKey* key = &keys[i];
+        memset(key, 0, sizeof(BTreeKey));
+        strncpy(key->name, filename, MAX_NAME_LEN - 1);
+        key->threshold = thresholds[i];
+        key->data_offset = offset;
+        key->data_size = (int)streams[i].size;
+        key->width = original->width;
+        key->height = original->height;
         
-        btree_insert(key);
+        free(streams[i].data);
         
-        free(compressed);
-        image_free(copy);
-        
-        printf("✅ (offset: %ld, tamanho: %d bytes)\n", offset, compressed_size);
+        printf("✅ (offset: %ld, tamanho: %d bytes)\n", offset, key->data_size);
     }
+    fclose(data_file);
+    
+    // Uma única transação e um único fsync do log para todas as versões
+    btree_insert_batch(keys, count);
+    btree_sync();
     
+    free(streams);
+    free(keys);
     image_free(original);
     printf("=== CONCLUÍDO: %d VERSÕES ADICIONADAS ===\n\n", count);
 }
@@ -340,7 +1077,7 @@ void database_add_multiple_thresholds(const char* filename, int thresholds[], in
 /**
  * Recupera imagem do banco de dados
  */
-void database_retrieve_image(const char* name, int threshold, const char* output) {
+void database_retrieve_image(const char* name, int threshold, const char* output, int format) {
     BTreeKey key;
     if (!btree_search(name, threshold, &key)) {
         printf("Imagem não encontrada: %s (limiar=%d)\n", name, threshold);
@@ -364,85 +1101,136 @@ void database_retrieve_image(const char* name, int threshold, const char* output
     fread(compressed, 1, key.data_size, data_file);
     fclose(data_file);
     
-    int** pixels = image_decompress_rle(compressed, key.data_size, key.width, key.height);
-    if (!pixels) {
-        printf("Erro na descompressão\n");
-        free(compressed);
-        return;
-    }
-    
-    PGMImage* img = malloc(sizeof(PGMImage));
-    if (!img) {
-        printf("Erro de alocação\n");
-        free(compressed);
-        for (int i = 0; i < key.height; i++) free(pixels[i]);
-        free(pixels);
-        return;
-    }
-    
-    img->width = key.width;
-    img->height = key.height;
-    img->max_gray = 1;
-    img->pixels = pixels;
-    
-    if (image_write_pgm(output, img)) {
+    // Gravado direto das sequências RLE, sem descomprimir para a matriz
+    if (image_write_rle(output, compressed, key.data_size, key.width, key.height, format)) {
         printf("✅ Imagem recuperada: %s\n", output);
     } else {
         printf("❌ Erro ao salvar: %s\n", output);
     }
     
-    image_free(img);
     free(compressed);
 }
 
 /**
- * Lista todas as imagens
+ * Lista todas as imagens em ordem alfabética
+ * O índice agrupa as chaves pelo id do nome (ordem de cadastro): uma única
+ * varredura pelas folhas coleta as chaves e os grupos de cada id são
+ * impressos na ordem dos nomes do dicionário (memória proporcional ao
+ * número de chaves)
  */
 void database_list_images() {
-    btree_print_inorder();
+    BTreeCursor cursor;
+    BTreeKey key;
+    ImageListEntry* entries = NULL;
+    int count = 0;
+    int capacity = 0;
+    
+    // Uma varredura pelas folhas: as chaves vêm agrupadas por id de nome
+    // (ordem de cadastro), com os limiares de cada nome já crescentes
+    btree_seek(&cursor, "", INT_MIN);
+    while (btree_next(&cursor, &key)) {
+        if (count == capacity) {
+            int new_capacity = capacity ? capacity * 2 : 256;
+            ImageListEntry* temp = realloc(entries, new_capacity * sizeof(ImageListEntry));
+            if (!temp) {
+                fprintf(stderr, "Erro: Falha na alocação da listagem\n");
+                btree_cursor_close(&cursor);
+                free(entries);
+                return;
+            }
+            entries = temp;
+            capacity = new_capacity;
+        }
+        ImageListEntry* entry = &entries[count++];
+        entry->name_id = key.name_id;
+        entry->threshold = key.threshold;
+        entry->width = key.width;
+        entry->height = key.height;
+        entry->data_size = key.data_size;
+    }
+    
+    // Grupo de cada id no vetor; os grupos saem na ordem alfabética dos nomes
+    unsigned int total;
+    unsigned int* ids = names_sorted(&total);
+    int* first = malloc((total + 1) * sizeof(int));
+    int* length = calloc(total + 1, sizeof(int));
+    if (!ids || !first || !length) {
+        fprintf(stderr, "Erro: Falha na alocação da listagem\n");
+        free(ids);
+        free(first);
+        free(length);
+        free(entries);
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        unsigned int id = entries[i].name_id;
+        if (id >= total) continue;
+        if (length[id]++ == 0) first[id] = i;
+    }
+    
+    printf("\n=== IMAGENS NO BANCO DE DADOS ===\n");
+    int listed = 0;
+    for (unsigned int i = 0; i < total; i++) {
+        unsigned int id = ids[i];
+        const char* name = names_get(id);
+        for (int j = first[id]; j < first[id] + length[id]; j++) {
+            printf("%d. Nome: %-20s | Limiar: %3d | Dimensões: %4dx%4d | Tamanho: %d bytes\n",
+                   ++listed, name, entries[j].threshold, entries[j].width, entries[j].height,
+                   entries[j].data_size);
+        }
+    }
+    free(ids);
+    free(first);
+    free(length);
+    free(entries);
+    
+    if (listed == 0) {
+        printf("Nenhuma imagem cadastrada\n");
+    }
+    printf("==================================\n");
 }
 
 /**
- * Função auxiliar recursiva para compactação
+ * Lista todas as versões (limiares) de uma imagem
+ * O cursor começa em (name, INT_MIN) e para na primeira chave de outro id de nome
  */
-static void database_compact_recursive(long node_offset, FILE* old_data, FILE* new_data) {
-    BTreeNode* node = btree_read_node(node_offset);
-    if (!node) return;
+void database_list_versions(const char* name) {
+    BTreeCursor cursor;
+    BTreeKey key;
+    int count = 0;
     
-    for (int i = 0; i < node->num_keys; i++) {
-        if (!node->is_leaf) {
-            database_compact_recursive(node->children[i], old_data, new_data);
-        }
-        
-        unsigned char* data = malloc(node->keys[i].data_size);
-        if (!data) continue;
-        
-        fseek(old_data, node->keys[i].data_offset, SEEK_SET);
-        fread(data, 1, node->keys[i].data_size, old_data);
-        
-        long new_offset = ftell(new_data);
-        fwrite(data, 1, node->keys[i].data_size, new_data);
-        
-        node->keys[i].data_offset = new_offset;
-        free(data);
+    printf("\n=== VERSÕES DE %s ===\n", name);
+    unsigned int name_id = names_find(name);
+    btree_seek(&cursor, name, INT_MIN);
+    while (btree_next(&cursor, &key)) {
+        if (key.name_id != name_id) break;
+        printf("Limiar: %3d | Dimensões: %4dx%4d | Offset: %ld | Tamanho: %d bytes\n",
+               key.threshold, key.width, key.height, key.data_offset, key.data_size);
+        count++;
     }
+    btree_cursor_close(&cursor);
     
-    if (!node->is_leaf) {
-        database_compact_recursive(node->children[node->num_keys], old_data, new_data);
+    if (count == 0) {
+        printf("Nenhuma versão encontrada\n");
+    } else {
+        printf("Total: %d versões\n", count);
     }
-    
-    btree_write_node(node_offset, node);
-    free(node);
 }
 
 /**
  * Compacta arquivo de dados (apenas dados, não índices)
+ * Percorre as folhas em ordem e regrava o offset de cada registro
  */
 void database_compact() {
+    if (btree_is_read_only()) {
+        printf("Erro: Índice aberto somente para leitura\n");
+        return;
+    }
+    
     printf("\n=== INICIANDO COMPACTAÇÃO DO ARQUIVO DE DADOS ===\n");
     
-    FILE* old_data = fopen("image_data.dat", "rb");
-    FILE* new_data = fopen("data_temp.dat", "wb");
+    FILE* old_data = fopen(BTREE_DATA_FILE, "rb");
+    FILE* new_data = fopen(BTREE_DATA_TEMP_FILE, "wb");
     
     if (!old_data || !new_data) {
         printf("Erro ao abrir arquivos para compactação\n");
@@ -451,13 +1239,43 @@ void database_compact() {
         return;
     }
     
-    database_compact_recursive(btree_get_root_offset(), old_data, new_data);
+    // Registros copiados um depois do outro na ordem das chaves: é assim que
+    // btree_relocate_data recalcula os offsets (nada no índice muda aqui)
+    BTreeCursor cursor;
+    BTreeKey key;
+    unsigned char* data = NULL;
+    int capacity = 0;
+    int ok = 1;
+    
+    btree_seek(&cursor, "", INT_MIN);
+    while (ok && btree_next(&cursor, &key)) {
+        if (key.data_size > capacity) {
+            unsigned char* temp = realloc(data, key.data_size);
+            if (!temp) {
+                ok = 0;
+                break;
+            }
+            data = temp;
+            capacity = key.data_size;
+        }
+        
+        ok = fseek(old_data, key.data_offset, SEEK_SET) == 0 &&
+             fread(data, 1, key.data_size, old_data) == (size_t)key.data_size &&
+             fwrite(data, 1, key.data_size, new_data) == (size_t)key.data_size;
+    }
+    if (!ok) btree_cursor_close(&cursor);
+    free(data);
     
     fclose(old_data);
-    fclose(new_data);
+    ok = (fclose(new_data) == 0) && ok;
     
-    remove("image_data.dat");
-    rename("data_temp.dat", "image_data.dat");
+    if (!ok) {
+        printf("Erro: Falha ao copiar os registros; %s mantido como estava\n", BTREE_DATA_FILE);
+        remove(BTREE_DATA_TEMP_FILE);
+        return;
+    }
+    
+    btree_relocate_data();
     
     printf("Compactação concluída com sucesso\n");
-}
\ No newline at end of file
+}
@@ -3,24 +3,59 @@
 
 #include "btree.h"
 
+// Alinhamento do buffer e das linhas da imagem (bytes)
+#define IMAGE_ALIGN 32
+
+// Amostras num único buffer alinhado (linha i em data + i * stride); 1 byte
+// por amostra se max_gray <= 255, senão 2 (unsigned short)
 typedef struct {
     int width;
     int height;
     int max_gray;
-    int** pixels;
+    int binary;         // 1: arquivo P5 (amostras binárias), 0: P2 (ASCII)
+    int sample_bytes;   // 1 ou 2
+    int stride;         // bytes por linha (múltiplo de IMAGE_ALIGN)
+    unsigned char* data;
 } PGMImage;
 
+// Linha i da imagem com amostras de 8 ou de 16 bits
+#define IMAGE_ROW8(img, i) ((img)->data + (size_t)(i) * (img)->stride)
+#define IMAGE_ROW16(img, i) ((unsigned short*)((img)->data + (size_t)(i) * (img)->stride))
+
+// Imagem binária (resultado da limiarização) com 1 bit por pixel: pixel j da
+// linha i é o bit j % 64 da palavra j / 64; bits de sobra da linha ficam em 0
+typedef struct {
+    int width;
+    int height;
+    int words_per_row;
+    unsigned long long* bits;
+} BinaryImage;
+
+// Linha i (palavras de 64 bits) da imagem binária
+#define IMAGE_BINARY_ROW(img, i) ((img)->bits + (size_t)(i) * (img)->words_per_row)
+
+// Formatos de saída
+#define IMAGE_FORMAT_P2 2   // ASCII
+#define IMAGE_FORMAT_P4 4   // PBM, 1 bit por pixel (só imagens binárias)
+#define IMAGE_FORMAT_P5 5   // binário, 8 ou 16 bits por amostra
+
 // Interface pública do módulo de imagem
+PGMImage* image_create(int width, int height, int max_gray);
 PGMImage* image_read_pgm(const char* filename);
 int image_write_pgm(const char* filename, PGMImage* img);
-void image_binarize(PGMImage* img, int threshold);
+int image_write_pgm_format(const char* filename, PGMImage* img, int format);
+BinaryImage* image_binarize(const PGMImage* img, int threshold);
 void image_free(PGMImage* img);
+BinaryImage* image_create_binary(int width, int height);
+long image_count_white(const BinaryImage* img);
+void image_free_binary(BinaryImage* img);
 
 // Interface pública do banco de dados
 void database_add_image(const char* filename, int threshold);
 void database_add_multiple_thresholds(const char* filename, int thresholds[], int count);
-void database_retrieve_image(const char* name, int threshold, const char* output);
+void database_retrieve_image(const char* name, int threshold, const char* output, int format);
 void database_list_images();
+void database_list_versions(const char* name);
 void database_compact();
 
 #endif
\ No newline at end of file
@@ -1,7 +1,9 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include "btree.h"
 #include "image.h"
+#include "simd.h"
 
 #define MAX_THRESHOLDS 10
 
@@ -9,11 +11,19 @@
  * Sistema de Gerenciamento de Imagens com Árvore-B
  * 
  * Funcionalidades implementadas:
- * Árvore-B de ordem 3 páginada
+ * Árvore-B+ páginada com ordem definida na criação do arquivo
+ * Folhas encadeadas com cursor para varreduras por intervalo
  * Operações de inserção e remoção clássicas
  * Inserção com múltiplos limiares
  * Virtualização da raiz
- * Compactação apenas do arquivo de dados
+ * Compactação do arquivo de dados e do índice (páginas livres reaproveitadas)
+ * Log de escrita antecipada (btree.wal) com commit em grupo e recuperação
+ * Índice seguro para leitores e escritores concorrentes (travas por página)
+ * Modo somente leitura com o índice mapeado em memória (--mmap)
+ * Filtro de Bloom que descarta buscas por chaves ausentes (--bloom)
+ * Limiarização vetorial (SSE2/AVX2/AVX-512) escolhida pela CPU (--simd)
+ * Dicionário de nomes (btree.names): o índice compara chaves (id, limiar) inteiras
+ * Recuperação em P2, P5 ou P4 gravada direto das sequências RLE
  * Impressão do conteúdo das páginas
  */
 
@@ -26,7 +36,9 @@ void display_menu() {
     printf("5. Remover imagem\n");
     printf("6. Compactar arquivo de dados\n");
     printf("7. Imprimir conteúdo das páginas\n");
-    printf("8. Percurso ordenado\n");
+    printf("8. Percurso pelas folhas (nomes na ordem de cadastro)\n");
+    printf("9. Listar versões de uma imagem\n");
+    printf("10. Compactar índice (reescrever btree.dat)\n");
     printf("0. Sair\n");
     printf("========================================\n");
     printf("Escolha: ");
@@ -37,17 +49,45 @@ void clear_input_buffer() {
     while ((c = getchar()) != '\n' && c != EOF);
 }
 
-int main() {
+int main(int argc, char* argv[]) {
+    // ./image_system [ordem] [--mmap] [--bloom=taxa] [--bloom-kb=limite] [--simd=variante]
+    // ordem: usada só ao criar um btree.dat novo
+    // --mmap: índice mapeado em memória, somente leitura (consultas)
+    // --bloom: taxa de falsos positivos do filtro (0 = sem filtro)
+    // --bloom-kb: memória máxima do filtro em KiB
+    // --simd: força escalar, sse2, avx2 ou avx512 (padrão: a melhor da CPU)
+    double bloom_fp = BTREE_BLOOM_FP;
+    long bloom_bytes = BTREE_BLOOM_MAX_BYTES;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--mmap") == 0) {
+            btree_set_mmap(1);
+        } else if (strncmp(argv[i], "--bloom=", 8) == 0) {
+            bloom_fp = atof(argv[i] + 8);
+        } else if (strncmp(argv[i], "--bloom-kb=", 11) == 0) {
+            bloom_bytes = atol(argv[i] + 11) * 1024;
+        } else if (strncmp(argv[i], "--simd=", 7) == 0) {
+            if (!simd_force(argv[i] + 7)) {
+                printf("Erro: Variante %s desconhecida ou não suportada pela CPU\n", argv[i] + 7);
+            }
+        } else {
+            btree_set_order(atoi(argv[i]));
+        }
+    }
+    btree_set_bloom(bloom_fp, bloom_bytes);
     btree_init();
     
     printf("===============================================\n");
     printf("  SISTEMA DE GERENCIAMENTO DE IMAGENS BINÁRIAS\n");
-    printf("         ÁRVORE-B DE ORDEM %d (PÁGINADA)\n", ORDER);
+    printf("         ÁRVORE-B DE ORDEM %d (PÁGINADA)\n", btree_get_order());
+    if (btree_is_read_only()) {
+        printf("     ÍNDICE MAPEADO EM MEMÓRIA (SOMENTE LEITURA)\n");
+    }
+    printf("     LIMIARIZAÇÃO: %s\n", simd_name());
     printf("===============================================\n");
     
     int choice;
-    char filename[100], output[100];
-    int threshold, count;
+    char filename[MAX_NAME_LEN], output[MAX_NAME_LEN];
+    int threshold, count, format;
     int thresholds[MAX_THRESHOLDS];
     
     do {
@@ -62,7 +102,7 @@ int main() {
         switch (choice) {
             case 1:
                 printf("Nome do arquivo PGM: ");
-                scanf("%99s", filename);
+                scanf("%255s", filename);
                 printf("Quantidade de limiares (1-%d): ", MAX_THRESHOLDS);
                 if (scanf("%d", &count) != 1 || count < 1 || count > MAX_THRESHOLDS) {
                     printf("Quantidade inválida!\n");
@@ -79,10 +119,10 @@ int main() {
                 }
                 database_add_multiple_thresholds(filename, thresholds, count);
                 break;
-                
+            
             case 2:
                 printf("Nome do arquivo PGM: ");
-                scanf("%99s", filename);
+                scanf("%255s", filename);
                 printf("Limiar (0-255): ");
                 if (scanf("%d", &threshold) != 1) {
                     printf("Limiar inválido!\n");
@@ -91,10 +131,10 @@ int main() {
                 }
                 database_add_image(filename, threshold);
                 break;
-                
+            
             case 3:
                 printf("Nome da imagem: ");
-                scanf("%99s", filename);
+                scanf("%255s", filename);
                 printf("Limiar utilizado: ");
                 if (scanf("%d", &threshold) != 1) {
                     printf("Limiar inválido!\n");
@@ -102,17 +142,23 @@ int main() {
                     break;
                 }
                 printf("Nome do arquivo de saída: ");
-                scanf("%99s", output);
-                database_retrieve_image(filename, threshold, output);
+                scanf("%255s", output);
+                printf("Formato de saída (2 = P2, 5 = P5, 4 = P4/PBM): ");
+                if (scanf("%d", &format) != 1) {
+                    clear_input_buffer();
+                    format = IMAGE_FORMAT_P2;
+                }
+                if (format != IMAGE_FORMAT_P5 && format != IMAGE_FORMAT_P4) format = IMAGE_FORMAT_P2;
+                database_retrieve_image(filename, threshold, output, format);
                 break;
-                
+            
             case 4:
                 database_list_images();
                 break;
-                
+            
             case 5:
                 printf("Nome da imagem: ");
-                scanf("%99s", filename);
+                scanf("%255s", filename);
                 printf("Limiar: ");
                 if (scanf("%d", &threshold) != 1) {
                     printf("Limiar inválido!\n");
@@ -120,32 +166,44 @@ int main() {
                     break;
                 }
                 btree_delete(filename, threshold);
+                btree_sync();
                 printf("Operação de remoção concluída\n");
                 break;
-                
+            
             case 6:
                 database_compact();
                 break;
-                
+            
             case 7:
                 btree_print_pages();
                 break;
-                
+            
             case 8:
                 btree_print_inorder();
                 break;
-                
+            
+            case 9:
+                printf("Nome da imagem: ");
+                scanf("%255s", filename);
+                database_list_versions(filename);
+                break;
+            
+            case 10:
+                btree_vacuum(BTREE_DEFAULT_FILL);
+                break;
+            
             case 0:
                 printf("Encerrando o sistema...\n");
                 break;
-                
+            
             default:
                 printf("Opção inválida! Tente novamente.\n");
         }
         
         clear_input_buffer();
-        
+    
     } while (choice != 0);
     
+    btree_close();
     return 0;
 }
\ No newline at end of file
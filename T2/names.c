@@ -0,0 +1,308 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "names.h"
+#include <pthread.h>
+
+#ifdef _WIN32
+#include <io.h>
+#define names_fsync_fd(fd) _commit(fd)
+#define names_truncate_fd(fd, size) _chsize(fd, size)
+#else
+#include <unistd.h>
+#define names_fsync_fd(fd) fsync(fd)
+#define names_truncate_fd(fd, size) ftruncate(fd, size)
+#endif
+
+#define NAMES_MIN_TABLE 1024
+
+// Arquivo: NAMES_MAGIC seguido de um registro por nome, na ordem dos ids:
+// tamanho (unsigned short) + bytes do nome (sem '\0')
+// Registro incompleto no fim (queda no meio da gravação) é descartado: o
+// nome só é usado pelo índice depois de names_sync
+
+// Variáveis estáticas (names_latch: buscas compartilham, inserção é exclusiva)
+static pthread_rwlock_t names_latch = PTHREAD_RWLOCK_INITIALIZER;
+static FILE* names_file = NULL;
+static char** names_list = NULL;        // id -> nome (cada nome alocado à parte: ponteiro estável)
+static unsigned int names_total = 0;
+static unsigned int names_capacity = 0;
+static unsigned int* names_table = NULL; // espalhamento aberto: id + 1 (0 = vazio)
+static unsigned int names_table_size = 0;
+static int names_dirty = 0;
+static long names_lookups = 0;
+static long names_probes = 0;
+
+// Funções privadas
+static unsigned int names_hash(const char* name, int length);
+static unsigned int names_lookup(const char* name, int length, unsigned int* slot);
+static int names_add(const char* name, int length);
+static int names_grow_table();
+static int names_compare_ids(const void* a, const void* b);
+
+/**
+ * Abre (ou cria) o arquivo do dicionário e carrega todos os nomes
+ */
+int names_open(const char* filename) {
+    if (names_file) names_close();
+
+    names_file = fopen(filename, "r+b");
+    if (!names_file) {
+        names_file = fopen(filename, "w+b");
+        if (!names_file || fwrite(NAMES_MAGIC, 8, 1, names_file) != 1 || fflush(names_file) != 0) {
+            fprintf(stderr, "Erro: Não foi possível criar %s\n", filename);
+            if (names_file) fclose(names_file);
+            names_file = NULL;
+            return 0;
+        }
+    } else {
+        char magic[8];
+        if (fread(magic, 8, 1, names_file) != 1 || memcmp(magic, NAMES_MAGIC, 8) != 0) {
+            fprintf(stderr, "Erro: %s não é um dicionário de nomes\n", filename);
+            fclose(names_file);
+            names_file = NULL;
+            return 0;
+        }
+    }
+
+    if (!names_grow_table()) return 0;
+
+    char name[NAMES_MAX_LEN + 1];
+    long end = ftell(names_file);
+    unsigned short length;
+    while (fread(&length, sizeof(length), 1, names_file) == 1) {
+        if (length == 0 || length > NAMES_MAX_LEN || fread(name, length, 1, names_file) != 1 ||
+            memchr(name, '\0', length) != NULL) {
+            break;
+        }
+        name[length] = '\0';
+        if (!names_add(name, length)) {
+            names_close();
+            return 0;
+        }
+        end = ftell(names_file);
+    }
+
+    // Descarta o resto de uma gravação interrompida antes de acrescentar nomes
+    fflush(names_file);
+    if (names_truncate_fd(fileno(names_file), end) != 0) {
+        fprintf(stderr, "Erro: Não foi possível ajustar %s\n", filename);
+        names_close();
+        return 0;
+    }
+    fseek(names_file, end, SEEK_SET);
+    names_dirty = 0;
+    return 1;
+}
+
+/**
+ * Grava o que falta e libera o dicionário
+ */
+void names_close() {
+    if (names_file) {
+        names_sync();
+        fclose(names_file);
+        names_file = NULL;
+    }
+
+    for (unsigned int i = 0; i < names_total; i++) {
+        free(names_list[i]);
+    }
+    free(names_list);
+    free(names_table);
+    names_list = NULL;
+    names_table = NULL;
+    names_total = names_capacity = names_table_size = 0;
+    names_lookups = names_probes = 0;
+}
+
+/**
+ * Id do nome ou NAMES_NONE se ele nunca foi cadastrado
+ */
+unsigned int names_find(const char* name) {
+    int length = (int)strlen(name);
+    if (length == 0 || length > NAMES_MAX_LEN) return NAMES_NONE;
+
+    pthread_rwlock_rdlock(&names_latch);
+    unsigned int id = names_table ? names_lookup(name, length, NULL) : NAMES_NONE;
+    pthread_rwlock_unlock(&names_latch);
+    return id;
+}
+
+/**
+ * Id do nome, cadastrando-o no fim do arquivo se ainda não existe
+ * O nome novo só fica durável em names_sync (chamado antes do commit do
+ * índice que o usa). Retorna NAMES_NONE se o nome é vazio, longo demais
+ * ou não pôde ser gravado
+ */
+unsigned int names_intern(const char* name) {
+    int length = (int)strlen(name);
+    if (length == 0 || length > NAMES_MAX_LEN || !names_file) return NAMES_NONE;
+
+    pthread_rwlock_wrlock(&names_latch);
+    unsigned int id = names_lookup(name, length, NULL);
+    if (id == NAMES_NONE) {
+        unsigned short size = (unsigned short)length;
+        if (fwrite(&size, sizeof(size), 1, names_file) == 1 &&
+            fwrite(name, length, 1, names_file) == 1 && names_add(name, length)) {
+            id = names_total - 1;
+            names_dirty = 1;
+        } else {
+            fprintf(stderr, "Erro: Falha ao cadastrar o nome %s\n", name);
+        }
+    }
+    pthread_rwlock_unlock(&names_latch);
+    return id;
+}
+
+/**
+ * Nome do id (NULL se o id não existe); o ponteiro vale até names_close
+ */
+const char* names_get(unsigned int id) {
+    pthread_rwlock_rdlock(&names_latch);
+    const char* name = (id < names_total) ? names_list[id] : NULL;
+    pthread_rwlock_unlock(&names_latch);
+    return name;
+}
+
+/**
+ * Quantos nomes estão cadastrados
+ */
+unsigned int names_count() {
+    pthread_rwlock_rdlock(&names_latch);
+    unsigned int count = names_total;
+    pthread_rwlock_unlock(&names_latch);
+    return count;
+}
+
+/**
+ * Leva ao disco os nomes cadastrados desde a última chamada
+ */
+void names_sync() {
+    pthread_rwlock_wrlock(&names_latch);
+    if (names_file && names_dirty) {
+        if (fflush(names_file) != 0 || names_fsync_fd(fileno(names_file)) != 0) {
+            fprintf(stderr, "Erro: Falha ao gravar o dicionário de nomes\n");
+            exit(1);
+        }
+        names_dirty = 0;
+    }
+    pthread_rwlock_unlock(&names_latch);
+}
+
+/**
+ * Ids de todos os nomes em ordem alfabética (vetor alocado; o chamador libera)
+ */
+unsigned int* names_sorted(unsigned int* count) {
+    pthread_rwlock_rdlock(&names_latch);
+    *count = names_total;
+    unsigned int* ids = malloc((names_total + 1) * sizeof(unsigned int));
+    if (ids) {
+        for (unsigned int i = 0; i < names_total; i++) ids[i] = i;
+        qsort(ids, names_total, sizeof(unsigned int), names_compare_ids);
+    }
+    pthread_rwlock_unlock(&names_latch);
+    return ids;
+}
+
+/**
+ * Imprime tamanho do dicionário e custo médio das buscas
+ */
+void names_print_stats() {
+    pthread_rwlock_rdlock(&names_latch);
+    long lookups = __atomic_load_n(&names_lookups, __ATOMIC_RELAXED);
+    long probes = __atomic_load_n(&names_probes, __ATOMIC_RELAXED);
+    printf("Dicionário de nomes: %u nomes | Tabela: %u posições | Buscas: %ld (%.2f sondagens por busca)\n",
+           names_total, names_table_size, lookups, lookups ? (double)probes / lookups : 0.0);
+    pthread_rwlock_unlock(&names_latch);
+}
+
+/**
+ * FNV-1a de 32 bits do nome
+ */
+static unsigned int names_hash(const char* name, int length) {
+    unsigned int hash = 2166136261u;
+    for (int i = 0; i < length; i++) {
+        hash = (hash ^ (unsigned char)name[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Procura o nome na tabela (chamador segura names_latch)
+ * Retorna o id ou NAMES_NONE; slot recebe a posição onde ele está ou entraria
+ */
+static unsigned int names_lookup(const char* name, int length, unsigned int* slot) {
+    unsigned int mask = names_table_size - 1;
+    unsigned int i = names_hash(name, length) & mask;
+    long probes = 1;
+
+    while (names_table[i] != 0) {
+        unsigned int id = names_table[i] - 1;
+        if (memcmp(names_list[id], name, length + 1) == 0) break;
+        i = (i + 1) & mask;
+        probes++;
+    }
+
+    __atomic_add_fetch(&names_lookups, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&names_probes, probes, __ATOMIC_RELAXED);
+    if (slot) *slot = i;
+    return names_table[i] ? names_table[i] - 1 : NAMES_NONE;
+}
+
+/**
+ * Acrescenta o nome (ainda ausente) na memória com o próximo id
+ */
+static int names_add(const char* name, int length) {
+    if (names_total == names_capacity) {
+        unsigned int capacity = names_capacity ? names_capacity * 2 : 256;
+        char** temp = realloc(names_list, capacity * sizeof(char*));
+        if (!temp) return 0;
+        names_list = temp;
+        names_capacity = capacity;
+    }
+    // Tabela no máximo meio cheia: sondagens curtas
+    if ((names_total + 1) * 2 > names_table_size && !names_grow_table()) return 0;
+
+    char* copy = malloc(length + 1);
+    if (!copy) return 0;
+    memcpy(copy, name, length + 1);
+
+    unsigned int slot;
+    names_lookup(name, length, &slot);
+    names_list[names_total] = copy;
+    names_table[slot] = ++names_total;
+    return 1;
+}
+
+/**
+ * Dobra a tabela de espalhamento e reinsere os ids
+ */
+static int names_grow_table() {
+    unsigned int size = names_table_size ? names_table_size * 2 : NAMES_MIN_TABLE;
+    unsigned int* table = calloc(size, sizeof(unsigned int));
+    if (!table) {
+        fprintf(stderr, "Erro: Falha na alocação do dicionário de nomes\n");
+        return 0;
+    }
+
+    for (unsigned int id = 0; id < names_total; id++) {
+        const char* name = names_list[id];
+        unsigned int i = names_hash(name, (int)strlen(name)) & (size - 1);
+        while (table[i] != 0) i = (i + 1) & (size - 1);
+        table[i] = id + 1;
+    }
+
+    free(names_table);
+    names_table = table;
+    names_table_size = size;
+    return 1;
+}
+
+/**
+ * Ordem alfabética dos ids para qsort
+ */
+static int names_compare_ids(const void* a, const void* b) {
+    return strcmp(names_list[*(const unsigned int*)a], names_list[*(const unsigned int*)b]);
+}
@@ -0,0 +1,25 @@
+#ifndef NAMES_H
+#define NAMES_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define NAMES_MAGIC "BTNAMES1"
+#define NAMES_NONE 0xFFFFFFFFu
+#define NAMES_MAX_LEN 255
+
+// Dicionário persistente de nomes: cada nome de imagem recebe um id denso
+// (0, 1, 2, ... na ordem em que aparece) e o índice guarda só o id
+// O arquivo só cresce: um id nunca muda nem é reaproveitado
+int names_open(const char* filename);
+void names_close();
+unsigned int names_find(const char* name);
+unsigned int names_intern(const char* name);
+const char* names_get(unsigned int id);
+unsigned int names_count();
+void names_sync();
+unsigned int* names_sorted(unsigned int* count);
+void names_print_stats();
+
+#endif
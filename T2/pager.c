@@ -0,0 +1,583 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "pager.h"
+#include <pthread.h>
+
+#ifdef _WIN32
+#include <io.h>
+#define pager_fsync_fd(fd) _commit(fd)
+#else
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define pager_fsync_fd(fd) fsync(fd)
+#endif
+
+// Quadro (frame) do pool: uma página do arquivo em memória
+typedef struct {
+    long offset;      // offset da página no arquivo (-1 = quadro livre)
+    int pin_count;    // quantos usuários estão com a página fixada
+    int dirty;        // página modificada e ainda não escrita
+    int referenced;   // bit de referência do algoritmo do relógio
+    int next;         // próximo quadro na mesma lista do hash
+    long lsn;         // último registro do log que modificou a página (0 = nenhum)
+    pthread_rwlock_t latch;   // trava de leitura/escrita do conteúdo da página
+    int x_depth;              // reentrâncias da trava exclusiva (0 = livre ou compartilhada)
+    pthread_t x_owner;        // thread com a trava exclusiva (vale se x_depth > 0)
+    unsigned long version;    // par = estável, ímpar = escritor alterando a página
+} PagerFrame;
+
+// Variáveis estáticas - um único arquivo aberto durante toda a execução
+// (pager_mutex protege quadros, hash, relógio, estatísticas e o FILE*)
+static pthread_mutex_t pager_mutex = PTHREAD_MUTEX_INITIALIZER;
+static FILE* pager_file = NULL;
+static int pager_new_file = 0;
+static int pager_page_size = 0;
+static int pager_frame_count = 0;
+static unsigned char* pager_data = NULL;
+static PagerFrame* pager_frames = NULL;
+static int* pager_buckets = NULL;
+static int pager_bucket_count = 0;
+static int pager_clock_hand = 0;
+static long pager_hits = 0;
+static long pager_misses = 0;
+static long pager_reads = 0;
+static long pager_writes = 0;
+static PagerWalHook pager_wal_hook = NULL;
+
+// Modo mapeado (somente leitura): páginas são ponteiros direto no mapeamento
+static unsigned char* pager_map_base = NULL;
+static long pager_map_size = 0;
+
+// Funções privadas
+static int pager_hash(long offset);
+static int pager_lookup(long offset);
+static void pager_hash_insert(int frame);
+static void pager_hash_remove(int frame);
+static int pager_frame_of(void* page);
+static int pager_write_frame(int frame);
+static int pager_evict();
+static void* pager_fix(long offset, int load);
+static void* pager_mapped_page(long offset);
+static int pager_is_mapped(void* page);
+static int pager_latch_owned(PagerFrame* f, pthread_t self);
+
+/**
+ * Abre o arquivo de páginas e aloca os quadros do pool
+ */
+int pager_open(const char* filename, int page_size, int frames) {
+    if (pager_file) pager_close();
+
+    pager_file = fopen(filename, "r+b");
+    pager_new_file = 0;
+    if (!pager_file) {
+        pager_file = fopen(filename, "w+b");
+        pager_new_file = 1;
+    }
+    if (!pager_file) {
+        fprintf(stderr, "Erro: Não foi possível abrir %s\n", filename);
+        return 0;
+    }
+
+    // O pool já faz o cache; o buffer do stdio só duplicaria as cópias
+    setvbuf(pager_file, NULL, _IONBF, 0);
+
+    if (frames <= 0) frames = PAGER_DEFAULT_FRAMES;
+    pager_page_size = page_size;
+    pager_frame_count = frames;
+    pager_bucket_count = frames * 2;
+
+    pager_data = malloc((size_t)frames * page_size);
+    pager_frames = malloc(frames * sizeof(PagerFrame));
+    pager_buckets = malloc(pager_bucket_count * sizeof(int));
+    if (!pager_data || !pager_frames || !pager_buckets) {
+        fprintf(stderr, "Erro: Falha na alocação do pool de buffers\n");
+        free(pager_data);
+        free(pager_frames);
+        free(pager_buckets);
+        fclose(pager_file);
+        pager_file = NULL;
+        return 0;
+    }
+
+    for (int i = 0; i < frames; i++) {
+        pager_frames[i].offset = -1;
+        pager_frames[i].pin_count = 0;
+        pager_frames[i].dirty = 0;
+        pager_frames[i].referenced = 0;
+        pager_frames[i].next = -1;
+        pager_frames[i].lsn = 0;
+        pager_frames[i].x_depth = 0;
+        pager_frames[i].version = 0;
+        pthread_rwlock_init(&pager_frames[i].latch, NULL);
+    }
+    for (int i = 0; i < pager_bucket_count; i++) {
+        pager_buckets[i] = -1;
+    }
+
+    pager_clock_hand = 0;
+    pager_hits = pager_misses = pager_reads = pager_writes = 0;
+    return 1;
+}
+
+/**
+ * Grava as páginas sujas e libera o pool
+ */
+void pager_close() {
+    if (!pager_file) return;
+
+    pager_flush();
+    pager_unmap();
+    fclose(pager_file);
+    pager_file = NULL;
+
+    for (int i = 0; i < pager_frame_count; i++) {
+        pthread_rwlock_destroy(&pager_frames[i].latch);
+    }
+    free(pager_data);
+    free(pager_frames);
+    free(pager_buckets);
+    pager_data = NULL;
+    pager_frames = NULL;
+    pager_buckets = NULL;
+}
+
+/**
+ * Indica se o arquivo foi criado na abertura
+ */
+int pager_is_new_file() {
+    return pager_new_file;
+}
+
+/**
+ * Fixa a página do offset no pool, lendo do disco se necessário
+ */
+void* pager_pin(long offset) {
+    // Mapeado: a página já está na memória (cache do kernel), sem cópia nem trava
+    if (pager_map_base) return pager_mapped_page(offset);
+
+    pthread_mutex_lock(&pager_mutex);
+    void* page = pager_fix(offset, 1);
+    pthread_mutex_unlock(&pager_mutex);
+    return page;
+}
+
+/**
+ * Fixa uma página recém-alocada, sem leitura do disco
+ * Se a página ainda estava no pool (reaproveitada da lista de livres), o
+ * conteúdo antigo fica como está: um leitor otimista com ponteiro antigo
+ * pode estar nela, então o chamador a zera sob a trava exclusiva, que muda
+ * a versão e faz esse leitor descartar o que viu
+ */
+void* pager_pin_new(long offset) {
+    if (pager_map_base) {
+        fprintf(stderr, "Erro: Arquivo mapeado é somente leitura\n");
+        return NULL;
+    }
+
+    pthread_mutex_lock(&pager_mutex);
+    void* page = pager_fix(offset, 0);
+    pthread_mutex_unlock(&pager_mutex);
+    return page;
+}
+
+/**
+ * Libera a fixação de uma página (dirty = 1 se foi modificada)
+ */
+void pager_unpin(void* page, int dirty) {
+    int frame = pager_frame_of(page);
+    if (frame < 0) return;
+
+    pthread_mutex_lock(&pager_mutex);
+    if (dirty) pager_frames[frame].dirty = 1;
+    if (pager_frames[frame].pin_count > 0) pager_frames[frame].pin_count--;
+    pthread_mutex_unlock(&pager_mutex);
+}
+
+/**
+ * Marca página fixada como modificada
+ */
+void pager_mark_dirty(void* page) {
+    int frame = pager_frame_of(page);
+    if (frame < 0) return;
+
+    pthread_mutex_lock(&pager_mutex);
+    pager_frames[frame].dirty = 1;
+    pthread_mutex_unlock(&pager_mutex);
+}
+
+/**
+ * Trava o conteúdo de uma página fixada (exclusive = 1 para alterar)
+ * Leitores compartilham a trava; a exclusiva é reentrante só para a thread
+ * que já a tem (x_owner), as outras esperam por ela
+ */
+void pager_latch(void* page, int exclusive) {
+    int frame = pager_frame_of(page);
+    if (frame < 0) return;
+
+    PagerFrame* f = &pager_frames[frame];
+    if (!exclusive) {
+        pthread_rwlock_rdlock(&f->latch);
+        return;
+    }
+
+    pthread_t self = pthread_self();
+    if (pager_latch_owned(f, self)) {
+        f->x_depth++;
+        return;
+    }
+    pthread_rwlock_wrlock(&f->latch);
+    __atomic_store(&f->x_owner, &self, __ATOMIC_RELAXED);
+    __atomic_store_n(&f->x_depth, 1, __ATOMIC_RELEASE);
+    __atomic_add_fetch(&f->version, 1, __ATOMIC_RELEASE);
+}
+
+/**
+ * Solta a trava obtida com pager_latch
+ */
+void pager_unlatch(void* page) {
+    int frame = pager_frame_of(page);
+    if (frame < 0) return;
+
+    PagerFrame* f = &pager_frames[frame];
+    if (pager_latch_owned(f, pthread_self())) {
+        if (f->x_depth > 1) {
+            f->x_depth--;
+            return;
+        }
+        __atomic_store_n(&f->x_depth, 0, __ATOMIC_RELAXED);
+        __atomic_add_fetch(&f->version, 1, __ATOMIC_RELEASE);
+    }
+    pthread_rwlock_unlock(&f->latch);
+}
+
+/**
+ * Indica se a thread tem a trava exclusiva do quadro
+ * Outra thread só vê x_depth > 0 com x_owner já gravado; o dono é o único
+ * que altera os dois enquanto tem a trava
+ */
+static int pager_latch_owned(PagerFrame* f, pthread_t self) {
+    if (__atomic_load_n(&f->x_depth, __ATOMIC_ACQUIRE) == 0) return 0;
+
+    pthread_t owner;
+    __atomic_load(&f->x_owner, &owner, __ATOMIC_RELAXED);
+    return pthread_equal(owner, self);
+}
+
+/**
+ * Versão da página para leitura otimista (sem trava)
+ * Valor ímpar: há um escritor alterando a página neste momento
+ */
+unsigned long pager_page_version(void* page) {
+    // Página mapeada nunca muda (modo somente leitura)
+    if (pager_is_mapped(page)) return 0;
+
+    int frame = pager_frame_of(page);
+    if (frame < 0) return 1;
+
+    return __atomic_load_n(&pager_frames[frame].version, __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Escreve no disco todas as páginas sujas
+ */
+void pager_flush() {
+    if (!pager_file) return;
+
+    pthread_mutex_lock(&pager_mutex);
+    for (int i = 0; i < pager_frame_count; i++) {
+        if (pager_frames[i].offset != -1 && pager_frames[i].dirty) {
+            pager_write_frame(i);
+        }
+    }
+    fflush(pager_file);
+    pthread_mutex_unlock(&pager_mutex);
+}
+
+/**
+ * Força os dados já escritos do arquivo até o disco (fsync)
+ */
+void pager_sync() {
+    if (!pager_file) return;
+
+    pthread_mutex_lock(&pager_mutex);
+    fflush(pager_file);
+    pager_fsync_fd(fileno(pager_file));
+    pthread_mutex_unlock(&pager_mutex);
+}
+
+/**
+ * Associa à página o LSN do registro de log que a descreve
+ */
+void pager_set_page_lsn(void* page, long lsn) {
+    int frame = pager_frame_of(page);
+    if (frame < 0) return;
+
+    pthread_mutex_lock(&pager_mutex);
+    pager_frames[frame].lsn = lsn;
+    pthread_mutex_unlock(&pager_mutex);
+}
+
+/**
+ * Registra a função chamada antes de gravar uma página com LSN, para que
+ * o log chegue ao disco antes da página (NULL desativa)
+ */
+void pager_set_wal_hook(PagerWalHook hook) {
+    pager_wal_hook = hook;
+}
+
+/**
+ * Passa a ler o arquivo por mapeamento em memória (somente leitura)
+ * As páginas modificadas são gravadas antes; depois disso pager_pin devolve
+ * ponteiros para o mapeamento e o pool não é mais usado para leituras
+ * Retorna 0 se o mapeamento não for possível (o pool continua valendo)
+ */
+int pager_map() {
+    if (!pager_file) return 0;
+    if (pager_map_base) return 1;
+
+#ifdef _WIN32
+    return 0;
+#else
+    pager_flush();
+
+    struct stat info;
+    if (fstat(fileno(pager_file), &info) != 0 || info.st_size == 0) return 0;
+
+    void* base = mmap(NULL, info.st_size, PROT_READ, MAP_SHARED, fileno(pager_file), 0);
+    if (base == MAP_FAILED) return 0;
+
+    // Buscas na árvore saltam entre páginas: leitura antecipada não ajuda
+    posix_madvise(base, info.st_size, POSIX_MADV_RANDOM);
+
+    pager_map_size = info.st_size;
+    pager_map_base = base;
+    return 1;
+#endif
+}
+
+/**
+ * Desfaz o mapeamento (volta a usar o pool)
+ */
+void pager_unmap() {
+    if (!pager_map_base) return;
+
+#ifndef _WIN32
+    munmap(pager_map_base, pager_map_size);
+#endif
+    pager_map_base = NULL;
+    pager_map_size = 0;
+}
+
+/**
+ * Indica se o arquivo está mapeado
+ */
+int pager_is_map_mode() {
+    return pager_map_base != NULL;
+}
+
+/**
+ * Leitura direta fora do pool (cabeçalho do arquivo)
+ */
+int pager_read_raw(long offset, void* buffer, size_t size) {
+    pthread_mutex_lock(&pager_mutex);
+    int ok = pager_file && fseek(pager_file, offset, SEEK_SET) == 0 &&
+             fread(buffer, size, 1, pager_file) == 1;
+    pthread_mutex_unlock(&pager_mutex);
+    return ok;
+}
+
+/**
+ * Escrita direta fora do pool (cabeçalho do arquivo)
+ */
+int pager_write_raw(long offset, const void* buffer, size_t size) {
+    pthread_mutex_lock(&pager_mutex);
+    int ok = pager_file && fseek(pager_file, offset, SEEK_SET) == 0 &&
+             fwrite(buffer, size, 1, pager_file) == 1;
+    pthread_mutex_unlock(&pager_mutex);
+    return ok;
+}
+
+/**
+ * Imprime estatísticas de uso do pool
+ */
+void pager_print_stats() {
+    pthread_mutex_lock(&pager_mutex);
+    long total = pager_hits + pager_misses;
+    printf("Pool de buffers: %d quadros de %d bytes | Acertos: %ld | Faltas: %ld (%.1f%% acertos) | Leituras: %ld | Escritas: %ld\n",
+           pager_frame_count, pager_page_size, pager_hits, pager_misses,
+           total ? 100.0 * pager_hits / total : 0.0, pager_reads, pager_writes);
+    if (pager_map_base) {
+        printf("Arquivo mapeado em memória (somente leitura): %ld bytes\n", pager_map_size);
+    }
+    pthread_mutex_unlock(&pager_mutex);
+}
+
+/**
+ * Função de espalhamento do offset
+ */
+static int pager_hash(long offset) {
+    unsigned long h = (unsigned long)offset;
+    h ^= h >> 16;
+    h *= 0x45d9f3bUL;
+    h ^= h >> 16;
+    return (int)(h % (unsigned long)pager_bucket_count);
+}
+
+/**
+ * Procura quadro que contém o offset
+ */
+static int pager_lookup(long offset) {
+    int frame = pager_buckets[pager_hash(offset)];
+    while (frame != -1 && pager_frames[frame].offset != offset) {
+        frame = pager_frames[frame].next;
+    }
+    return frame;
+}
+
+/**
+ * Insere quadro na tabela hash
+ */
+static void pager_hash_insert(int frame) {
+    int bucket = pager_hash(pager_frames[frame].offset);
+    pager_frames[frame].next = pager_buckets[bucket];
+    pager_buckets[bucket] = frame;
+}
+
+/**
+ * Remove quadro da tabela hash
+ */
+static void pager_hash_remove(int frame) {
+    int bucket = pager_hash(pager_frames[frame].offset);
+    int* link = &pager_buckets[bucket];
+
+    while (*link != -1) {
+        if (*link == frame) {
+            *link = pager_frames[frame].next;
+            break;
+        }
+        link = &pager_frames[*link].next;
+    }
+    pager_frames[frame].next = -1;
+}
+
+/**
+ * Página no mapeamento (NULL se além do fim do arquivo mapeado)
+ */
+static void* pager_mapped_page(long offset) {
+    if (offset < 0 || offset + pager_page_size > pager_map_size) {
+        fprintf(stderr, "Erro: Offset %ld fora do arquivo mapeado\n", offset);
+        return NULL;
+    }
+    return pager_map_base + offset;
+}
+
+/**
+ * Indica se o ponteiro aponta para dentro do mapeamento
+ */
+static int pager_is_mapped(void* page) {
+    unsigned char* p = page;
+    return pager_map_base && p >= pager_map_base && p < pager_map_base + pager_map_size;
+}
+
+/**
+ * Converte ponteiro de página no índice do quadro
+ */
+static int pager_frame_of(void* page) {
+    unsigned char* p = page;
+    if (!pager_data || p < pager_data) return -1;
+
+    long diff = p - pager_data;
+    int frame = (int)(diff / pager_page_size);
+    if (frame >= pager_frame_count || diff % pager_page_size != 0) return -1;
+    return frame;
+}
+
+/**
+ * Escreve um quadro no disco
+ */
+static int pager_write_frame(int frame) {
+    unsigned char* page = pager_data + (size_t)frame * pager_page_size;
+
+    if (pager_wal_hook && pager_frames[frame].lsn > 0) {
+        pager_wal_hook(pager_frames[frame].lsn);
+    }
+
+    if (fseek(pager_file, pager_frames[frame].offset, SEEK_SET) != 0 ||
+        fwrite(page, pager_page_size, 1, pager_file) != 1) {
+        fprintf(stderr, "Erro: Falha ao gravar página no offset %ld\n", pager_frames[frame].offset);
+        return 0;
+    }
+
+    pager_frames[frame].dirty = 0;
+    pager_frames[frame].lsn = 0;
+    pager_writes++;
+    return 1;
+}
+
+/**
+ * Escolhe quadro vítima pelo algoritmo do relógio
+ */
+static int pager_evict() {
+    // Duas voltas: a primeira limpa os bits de referência
+    for (int step = 0; step < 2 * pager_frame_count; step++) {
+        int frame = pager_clock_hand;
+        pager_clock_hand = (pager_clock_hand + 1) % pager_frame_count;
+
+        if (pager_frames[frame].offset == -1) return frame;
+        if (pager_frames[frame].pin_count > 0) continue;
+
+        if (pager_frames[frame].referenced) {
+            pager_frames[frame].referenced = 0;
+            continue;
+        }
+
+        if (pager_frames[frame].dirty && !pager_write_frame(frame)) continue;
+        pager_hash_remove(frame);
+        pager_frames[frame].offset = -1;
+        return frame;
+    }
+
+    fprintf(stderr, "Erro: Todas as %d páginas do pool estão fixadas\n", pager_frame_count);
+    return -1;
+}
+
+/**
+ * Fixa página no pool (load = 0 para página nova, sem leitura)
+ */
+static void* pager_fix(long offset, int load) {
+    if (!pager_file || offset < 0) return NULL;
+
+    int frame = pager_lookup(offset);
+    if (frame != -1) {
+        pager_hits++;
+        if (!load) pager_frames[frame].dirty = 1;
+    } else {
+        pager_misses++;
+        frame = pager_evict();
+        if (frame < 0) return NULL;
+
+        unsigned char* page = pager_data + (size_t)frame * pager_page_size;
+        memset(page, 0, pager_page_size);
+
+        if (load) {
+            // Página além do fim do arquivo permanece zerada
+            if (fseek(pager_file, offset, SEEK_SET) == 0) {
+                fread(page, 1, pager_page_size, pager_file);
+            }
+            pager_reads++;
+        }
+
+        pager_frames[frame].offset = offset;
+        pager_frames[frame].dirty = !load;
+        pager_frames[frame].pin_count = 0;
+        pager_frames[frame].lsn = 0;
+        pager_hash_insert(frame);
+    }
+
+    pager_frames[frame].pin_count++;
+    pager_frames[frame].referenced = 1;
+    return pager_data + (size_t)frame * pager_page_size;
+}
@@ -0,0 +1,39 @@
+#ifndef PAGER_H
+#define PAGER_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PAGER_DEFAULT_FRAMES 64
+
+// Chamada antes de gravar uma página cujo registro de log ainda pode não
+// estar no disco (recebe o LSN da página)
+typedef void (*PagerWalHook)(long lsn);
+
+// Pool de buffers de páginas (cache com pin/unpin e escrita tardia)
+// Seguro para várias threads: o pool tem um mutex e cada página uma trava
+// de leitura/escrita (pager_latch) que só pode ser obtida com a página fixada
+// Em modo mapeado (pager_map) as páginas vêm direto do mmap, só para leitura
+int pager_open(const char* filename, int page_size, int frames);
+void pager_close();
+int pager_is_new_file();
+void* pager_pin(long offset);
+void* pager_pin_new(long offset);
+void pager_unpin(void* page, int dirty);
+void pager_mark_dirty(void* page);
+void pager_latch(void* page, int exclusive);
+void pager_unlatch(void* page);
+unsigned long pager_page_version(void* page);
+void pager_flush();
+void pager_sync();
+void pager_set_page_lsn(void* page, long lsn);
+void pager_set_wal_hook(PagerWalHook hook);
+int pager_map();
+void pager_unmap();
+int pager_is_map_mode();
+int pager_read_raw(long offset, void* buffer, size_t size);
+int pager_write_raw(long offset, const void* buffer, size_t size);
+void pager_print_stats();
+
+#endif
@@ -0,0 +1,256 @@
+#include "simd.h"
+
+// Variantes vetoriais só em x86 com GCC/Clang (cada função compilada para o
+// seu conjunto de instruções e escolhida em tempo de execução)
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SIMD_X86 1
+#include <immintrin.h>
+#endif
+
+// Kernels escolhidos para a CPU atual
+typedef struct {
+    const char* name;
+    void (*binarize8)(const unsigned char* in, int words, unsigned char threshold, unsigned long long* out);
+    void (*binarize16)(const unsigned short* in, int words, unsigned short threshold, unsigned long long* out);
+} SimdKernels;
+
+static SimdKernels kernels = { NULL, NULL, NULL };
+
+// Funções privadas
+static SimdKernels simd_variant(int level);
+static int simd_cpu_supports(int level);
+static void simd_select();
+static void simd_binarize8_scalar(const unsigned char* in, int words, unsigned char threshold, unsigned long long* out);
+static void simd_binarize16_scalar(const unsigned short* in, int words, unsigned short threshold, unsigned long long* out);
+#ifdef SIMD_X86
+static void simd_binarize8_sse2(const unsigned char* in, int words, unsigned char threshold, unsigned long long* out);
+static void simd_binarize16_sse2(const unsigned short* in, int words, unsigned short threshold, unsigned long long* out);
+static void simd_binarize8_avx2(const unsigned char* in, int words, unsigned char threshold, unsigned long long* out);
+static void simd_binarize16_avx2(const unsigned short* in, int words, unsigned short threshold, unsigned long long* out);
+static void simd_binarize8_avx512(const unsigned char* in, int words, unsigned char threshold, unsigned long long* out);
+static void simd_binarize16_avx512(const unsigned short* in, int words, unsigned short threshold, unsigned long long* out);
+#endif
+
+// Variantes em ordem de preferência (índice = nível)
+#define SIMD_LEVELS 4
+static const char* simd_level_names[SIMD_LEVELS] = { "escalar", "sse2", "avx2", "avx512" };
+
+/**
+ * Kernels do nível pedido (0 = escalar, 1 = SSE2, 2 = AVX2, 3 = AVX-512)
+ */
+static SimdKernels simd_variant(int level) {
+    SimdKernels variant = { "escalar", simd_binarize8_scalar, simd_binarize16_scalar };
+#ifdef SIMD_X86
+    if (level == 1) {
+        SimdKernels sse2 = { "SSE2", simd_binarize8_sse2, simd_binarize16_sse2 };
+        variant = sse2;
+    } else if (level == 2) {
+        SimdKernels avx2 = { "AVX2", simd_binarize8_avx2, simd_binarize16_avx2 };
+        variant = avx2;
+    } else if (level == 3) {
+        SimdKernels avx512 = { "AVX-512", simd_binarize8_avx512, simd_binarize16_avx512 };
+        variant = avx512;
+    }
+#endif
+    return variant;
+}
+
+/**
+ * Verifica se a CPU (e o sistema) suporta as instruções do nível
+ */
+static int simd_cpu_supports(int level) {
+    if (level == 0) return 1;
+#ifdef SIMD_X86
+    __builtin_cpu_init();
+    if (level == 1) return __builtin_cpu_supports("sse2");
+    if (level == 2) return __builtin_cpu_supports("avx2");
+    if (level == 3) return __builtin_cpu_supports("avx512bw");
+#endif
+    return 0;
+}
+
+/**
+ * Escolhe a melhor variante suportada pela CPU
+ */
+static void simd_select() {
+    int level = SIMD_LEVELS - 1;
+    while (!simd_cpu_supports(level)) level--;
+    kernels = simd_variant(level);
+}
+
+/**
+ * Força a variante pelo nome ("escalar", "sse2", "avx2" ou "avx512");
+ * retorna 0 (e mantém a escolha automática) se o nome é desconhecido ou a
+ * CPU não suporta as instruções
+ */
+int simd_force(const char* name) {
+    for (int level = 0; level < SIMD_LEVELS; level++) {
+        if (strcmp(name, simd_level_names[level]) == 0) {
+            if (!simd_cpu_supports(level)) return 0;
+            kernels = simd_variant(level);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/**
+ * Nome da variante de kernels em uso
+ */
+const char* simd_name() {
+    if (!kernels.name) simd_select();
+    return kernels.name;
+}
+
+/**
+ * Limiariza uma linha de amostras de 8 bits direto para bits (pixel > limiar
+ * vira 1): out recebe (width + 63) / 64 palavras, bits de sobra em 0
+ */
+void simd_binarize_row8(const unsigned char* in, int width, int threshold, unsigned long long* out) {
+    int words = (width + 63) / 64;
+    
+    if (threshold < 0 || threshold >= 255) {
+        // Limiar fora da faixa: tudo 1 ou tudo 0
+        unsigned long long fill = threshold < 0 ? ~0ULL : 0;
+        for (int k = 0; k < words; k++) out[k] = fill;
+    } else {
+        if (!kernels.binarize8) simd_select();
+        kernels.binarize8(in, width / 64, (unsigned char)threshold, out);
+        for (int j = width & ~63; j < width; j++) {
+            if (j % 64 == 0) out[j / 64] = 0;
+            out[j / 64] |= (unsigned long long)(in[j] > threshold) << (j % 64);
+        }
+    }
+    if (width % 64) out[words - 1] &= ~0ULL >> (64 - width % 64);
+}
+
+/**
+ * Limiariza uma linha de amostras de 16 bits direto para bits
+ */
+void simd_binarize_row16(const unsigned short* in, int width, int threshold, unsigned long long* out) {
+    int words = (width + 63) / 64;
+    
+    if (threshold < 0 || threshold >= 65535) {
+        unsigned long long fill = threshold < 0 ? ~0ULL : 0;
+        for (int k = 0; k < words; k++) out[k] = fill;
+    } else {
+        if (!kernels.binarize16) simd_select();
+        kernels.binarize16(in, width / 64, (unsigned short)threshold, out);
+        for (int j = width & ~63; j < width; j++) {
+            if (j % 64 == 0) out[j / 64] = 0;
+            out[j / 64] |= (unsigned long long)(in[j] > threshold) << (j % 64);
+        }
+    }
+    if (width % 64) out[words - 1] &= ~0ULL >> (64 - width % 64);
+}
+
+// Variante escalar: words palavras completas (64 amostras cada), sem desvios
+
+static void simd_binarize8_scalar(const unsigned char* in, int words, unsigned char threshold, unsigned long long* out) {
+    for (int k = 0; k < words; k++, in += 64) {
+        unsigned long long word = 0;
+        for (int b = 0; b < 64; b++) word |= (unsigned long long)(in[b] > threshold) << b;
+        out[k] = word;
+    }
+}
+
+static void simd_binarize16_scalar(const unsigned short* in, int words, unsigned short threshold, unsigned long long* out) {
+    for (int k = 0; k < words; k++, in += 64) {
+        unsigned long long word = 0;
+        for (int b = 0; b < 64; b++) word |= (unsigned long long)(in[b] > threshold) << b;
+        out[k] = word;
+    }
+}
+
+#ifdef SIMD_X86
+
+// SSE2: 16 amostras de 8 bits por comparação; sem comparação sem sinal, os
+// dois lados são deslocados por 0x80 (0x8000 em 16 bits) e comparados com sinal
+
+__attribute__((target("sse2")))
+static void simd_binarize8_sse2(const unsigned char* in, int words, unsigned char threshold, unsigned long long* out) {
+    const __m128i bias = _mm_set1_epi8((char)0x80);
+    const __m128i limit = _mm_set1_epi8((char)(threshold ^ 0x80));
+    for (int k = 0; k < words; k++, in += 64) {
+        unsigned long long word = 0;
+        for (int part = 0; part < 4; part++) {
+            __m128i v = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(in + part * 16)), bias);
+            unsigned long long mask = (unsigned)_mm_movemask_epi8(_mm_cmpgt_epi8(v, limit));
+            word |= mask << (part * 16);
+        }
+        out[k] = word;
+    }
+}
+
+__attribute__((target("sse2")))
+static void simd_binarize16_sse2(const unsigned short* in, int words, unsigned short threshold, unsigned long long* out) {
+    const __m128i bias = _mm_set1_epi16((short)0x8000);
+    const __m128i limit = _mm_set1_epi16((short)(threshold ^ 0x8000));
+    for (int k = 0; k < words; k++, in += 64) {
+        unsigned long long word = 0;
+        for (int part = 0; part < 4; part++) {
+            __m128i a = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(in + part * 16)), bias);
+            __m128i b = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(in + part * 16 + 8)), bias);
+            __m128i packed = _mm_packs_epi16(_mm_cmpgt_epi16(a, limit), _mm_cmpgt_epi16(b, limit));
+            unsigned long long mask = (unsigned)_mm_movemask_epi8(packed);
+            word |= mask << (part * 16);
+        }
+        out[k] = word;
+    }
+}
+
+// AVX2: 32 amostras de 8 bits por comparação; em 16 bits o empacotamento
+// intercala as metades de 128 bits, reordenadas antes da máscara
+
+__attribute__((target("avx2")))
+static void simd_binarize8_avx2(const unsigned char* in, int words, unsigned char threshold, unsigned long long* out) {
+    const __m256i bias = _mm256_set1_epi8((char)0x80);
+    const __m256i limit = _mm256_set1_epi8((char)(threshold ^ 0x80));
+    for (int k = 0; k < words; k++, in += 64) {
+        __m256i low = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)in), bias);
+        __m256i high = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(in + 32)), bias);
+        unsigned long long mask_low = (unsigned)_mm256_movemask_epi8(_mm256_cmpgt_epi8(low, limit));
+        unsigned long long mask_high = (unsigned)_mm256_movemask_epi8(_mm256_cmpgt_epi8(high, limit));
+        out[k] = mask_low | mask_high << 32;
+    }
+}
+
+__attribute__((target("avx2")))
+static void simd_binarize16_avx2(const unsigned short* in, int words, unsigned short threshold, unsigned long long* out) {
+    const __m256i bias = _mm256_set1_epi16((short)0x8000);
+    const __m256i limit = _mm256_set1_epi16((short)(threshold ^ 0x8000));
+    for (int k = 0; k < words; k++, in += 64) {
+        unsigned long long word = 0;
+        for (int part = 0; part < 2; part++) {
+            __m256i a = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(in + part * 32)), bias);
+            __m256i b = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(in + part * 32 + 16)), bias);
+            __m256i packed = _mm256_packs_epi16(_mm256_cmpgt_epi16(a, limit), _mm256_cmpgt_epi16(b, limit));
+            packed = _mm256_permute4x64_epi64(packed, 0xD8);
+            unsigned long long mask = (unsigned)_mm256_movemask_epi8(packed);
+            word |= mask << (part * 32);
+        }
+        out[k] = word;
+    }
+}
+
+// AVX-512BW: a comparação sem sinal já devolve a máscara de 64 (ou 32) bits
+
+__attribute__((target("avx512f,avx512bw")))
+static void simd_binarize8_avx512(const unsigned char* in, int words, unsigned char threshold, unsigned long long* out) {
+    const __m512i limit = _mm512_set1_epi8((char)threshold);
+    for (int k = 0; k < words; k++, in += 64) {
+        out[k] = _mm512_cmpgt_epu8_mask(_mm512_loadu_si512((const void*)in), limit);
+    }
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static void simd_binarize16_avx512(const unsigned short* in, int words, unsigned short threshold, unsigned long long* out) {
+    const __m512i limit = _mm512_set1_epi16((short)threshold);
+    for (int k = 0; k < words; k++, in += 64) {
+        unsigned long long low = _mm512_cmpgt_epu16_mask(_mm512_loadu_si512((const void*)in), limit);
+        unsigned long long high = _mm512_cmpgt_epu16_mask(_mm512_loadu_si512((const void*)(in + 32)), limit);
+        out[k] = low | high << 32;
+    }
+}
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Kernels de limiarização: a variante (AVX-512, AVX2, SSE2 ou escalar) é
+// escolhida pela CPU no primeiro uso ou forçada por simd_force (--simd)
+void simd_binarize_row8(const unsigned char* in, int width, int threshold, unsigned long long* out);
+void simd_binarize_row16(const unsigned short* in, int width, int threshold, unsigned long long* out);
+int simd_force(const char* name);
+const char* simd_name();
+
+#endif
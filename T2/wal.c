@@ -0,0 +1,283 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "wal.h"
+#include <pthread.h>
+
+#ifdef _WIN32
+#include <io.h>
+#define wal_fsync_fd(fd) _commit(fd)
+#else
+#include <unistd.h>
+#define wal_fsync_fd(fd) fsync(fd)
+#endif
+
+#define WAL_RECORD_MAGIC 0x57414C31u
+#define WAL_PAGE 1
+#define WAL_COMMIT 2
+#define WAL_BUFFER_SIZE (1 << 20)
+
+// Cabeçalho de cada registro do log (seguido de size bytes de dados)
+typedef struct {
+    unsigned int magic;
+    int type;
+    long offset;
+    int size;
+    unsigned int checksum;
+} WalRecordHeader;
+
+// Variáveis estáticas (wal_mutex protege o arquivo e os contadores: o
+// escritor grava commits enquanto o despejo de páginas pode forçar o log)
+static pthread_mutex_t wal_mutex = PTHREAD_MUTEX_INITIALIZER;
+static FILE* wal_file = NULL;
+static char wal_filename[256];
+static char* wal_buffer = NULL;
+static int wal_group_size = WAL_DEFAULT_GROUP;
+static int wal_pending_commits = 0;
+static long wal_end_lsn = 0;
+static long wal_durable_lsn = 0;
+static long wal_commits = 0;
+static long wal_syncs = 0;
+
+// Funções privadas
+static unsigned int wal_checksum(const WalRecordHeader* header, const void* data);
+static long wal_append(int type, long offset, const void* data, int size);
+static int wal_read_record(WalRecordHeader* header, void** data, int* capacity);
+static void wal_sync_locked();
+
+/**
+ * Abre (ou cria) o arquivo de log
+ * group_size = quantos commits são agrupados em um único fsync
+ */
+int wal_open(const char* filename, int group_size) {
+    if (wal_file) wal_close();
+
+    strncpy(wal_filename, filename, sizeof(wal_filename) - 1);
+    wal_filename[sizeof(wal_filename) - 1] = '\0';
+
+    wal_file = fopen(wal_filename, "r+b");
+    if (!wal_file) wal_file = fopen(wal_filename, "w+b");
+    if (!wal_file) {
+        fprintf(stderr, "Erro: Não foi possível abrir %s\n", wal_filename);
+        return 0;
+    }
+
+    // Registros são acumulados em memória e vão ao disco de uma vez no fsync
+    wal_buffer = malloc(WAL_BUFFER_SIZE);
+    if (wal_buffer) setvbuf(wal_file, wal_buffer, _IOFBF, WAL_BUFFER_SIZE);
+
+    wal_group_size = (group_size > 0) ? group_size : WAL_DEFAULT_GROUP;
+    wal_pending_commits = 0;
+    wal_commits = wal_syncs = 0;
+
+    fseek(wal_file, 0, SEEK_END);
+    wal_end_lsn = wal_durable_lsn = ftell(wal_file);
+    return 1;
+}
+
+/**
+ * Fecha o log (o chamador deve ter feito o checkpoint antes)
+ */
+void wal_close() {
+    if (!wal_file) return;
+
+    wal_sync();
+    fclose(wal_file);
+    wal_file = NULL;
+    free(wal_buffer);
+    wal_buffer = NULL;
+}
+
+/**
+ * Reaplica as transações confirmadas que estão no log
+ * Registros depois do último commit válido (escrita interrompida) são
+ * ignorados. Retorna o número de transações reaplicadas
+ */
+int wal_recover(WalApplyFn apply) {
+    if (!wal_file) return 0;
+
+    WalRecordHeader header;
+    void* data = NULL;
+    int capacity = 0;
+    long last_commit_end = 0;
+    int commits = 0;
+
+    // 1ª passada: encontra o fim do último commit íntegro
+    rewind(wal_file);
+    while (wal_read_record(&header, &data, &capacity)) {
+        if (header.type == WAL_COMMIT) {
+            last_commit_end = ftell(wal_file);
+            commits++;
+        }
+    }
+
+    // 2ª passada: reaplica tudo o que vem antes dele, na ordem do log
+    rewind(wal_file);
+    while (ftell(wal_file) < last_commit_end && wal_read_record(&header, &data, &capacity)) {
+        apply(header.offset, data, header.size);
+    }
+
+    free(data);
+    return commits;
+}
+
+/**
+ * Acrescenta a imagem de uma página modificada; retorna o LSN do registro
+ */
+long wal_append_page(long offset, const void* page, int size) {
+    pthread_mutex_lock(&wal_mutex);
+    long lsn = wal_append(WAL_PAGE, offset, page, size);
+    pthread_mutex_unlock(&wal_mutex);
+    return lsn;
+}
+
+/**
+ * Fecha uma transação gravando o cabeçalho da árvore como registro de commit
+ * O fsync só acontece a cada wal_group_size commits (commit em grupo)
+ */
+long wal_commit(const void* header, int size) {
+    pthread_mutex_lock(&wal_mutex);
+    long lsn = wal_append(WAL_COMMIT, 0, header, size);
+    wal_commits++;
+
+    if (++wal_pending_commits >= wal_group_size) {
+        wal_sync_locked();
+    }
+    pthread_mutex_unlock(&wal_mutex);
+    return lsn;
+}
+
+/**
+ * Torna durável tudo o que já foi acrescentado ao log
+ */
+void wal_sync() {
+    pthread_mutex_lock(&wal_mutex);
+    wal_sync_locked();
+    pthread_mutex_unlock(&wal_mutex);
+}
+
+/**
+ * fsync do log (chamador já tem o wal_mutex)
+ */
+static void wal_sync_locked() {
+    if (!wal_file || wal_durable_lsn == wal_end_lsn) return;
+
+    fflush(wal_file);
+    wal_fsync_fd(fileno(wal_file));
+    wal_durable_lsn = wal_end_lsn;
+    wal_pending_commits = 0;
+    wal_syncs++;
+}
+
+/**
+ * Garante que o log esteja durável até o LSN (regra do WAL: o registro
+ * precisa estar no disco antes da página ser gravada no arquivo de dados)
+ */
+void wal_force(long lsn) {
+    pthread_mutex_lock(&wal_mutex);
+    if (lsn > wal_durable_lsn) wal_sync_locked();
+    pthread_mutex_unlock(&wal_mutex);
+}
+
+/**
+ * Esvazia o log depois de um checkpoint
+ */
+void wal_reset() {
+    pthread_mutex_lock(&wal_mutex);
+    if (!wal_file) {
+        pthread_mutex_unlock(&wal_mutex);
+        return;
+    }
+
+    wal_file = freopen(wal_filename, "w+b", wal_file);
+    if (!wal_file) {
+        fprintf(stderr, "Erro: Não foi possível reiniciar %s\n", wal_filename);
+        exit(1);
+    }
+    if (wal_buffer) setvbuf(wal_file, wal_buffer, _IOFBF, WAL_BUFFER_SIZE);
+
+    wal_end_lsn = wal_durable_lsn = 0;
+    wal_pending_commits = 0;
+    pthread_mutex_unlock(&wal_mutex);
+}
+
+/**
+ * Tamanho atual do log em bytes
+ */
+long wal_size() {
+    pthread_mutex_lock(&wal_mutex);
+    long size = wal_end_lsn;
+    pthread_mutex_unlock(&wal_mutex);
+    return size;
+}
+
+/**
+ * Imprime estatísticas do log
+ */
+void wal_print_stats() {
+    printf("WAL: %ld commits em %ld fsyncs (grupo de %d) | Log atual: %ld bytes\n",
+           wal_commits, wal_syncs, wal_group_size, wal_end_lsn);
+}
+
+/**
+ * Soma de verificação (FNV-1a) do cabeçalho e dos dados do registro
+ */
+static unsigned int wal_checksum(const WalRecordHeader* header, const void* data) {
+    WalRecordHeader copy = *header;
+    copy.checksum = 0;
+
+    unsigned int hash = 2166136261u;
+    const unsigned char* bytes = (const unsigned char*)&copy;
+    for (size_t i = 0; i < sizeof(WalRecordHeader); i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    bytes = data;
+    for (int i = 0; i < header->size; i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * Acrescenta um registro ao log (ainda em buffer, não durável)
+ */
+static long wal_append(int type, long offset, const void* data, int size) {
+    if (!wal_file) return 0;
+
+    WalRecordHeader header;
+    memset(&header, 0, sizeof(WalRecordHeader));
+    header.magic = WAL_RECORD_MAGIC;
+    header.type = type;
+    header.offset = offset;
+    header.size = size;
+    header.checksum = wal_checksum(&header, data);
+
+    if (fwrite(&header, sizeof(WalRecordHeader), 1, wal_file) != 1 ||
+        fwrite(data, size, 1, wal_file) != 1) {
+        fprintf(stderr, "Erro: Falha ao gravar no log %s\n", wal_filename);
+        exit(1);
+    }
+
+    wal_end_lsn += sizeof(WalRecordHeader) + size;
+    return wal_end_lsn;
+}
+
+/**
+ * Lê o próximo registro; retorna 0 no fim ou em registro incompleto/corrompido
+ */
+static int wal_read_record(WalRecordHeader* header, void** data, int* capacity) {
+    if (fread(header, sizeof(WalRecordHeader), 1, wal_file) != 1) return 0;
+    if (header->magic != WAL_RECORD_MAGIC || header->size < 0 ||
+        (header->type != WAL_PAGE && header->type != WAL_COMMIT)) return 0;
+
+    if (header->size > *capacity) {
+        void* temp = realloc(*data, header->size);
+        if (!temp) return 0;
+        *data = temp;
+        *capacity = header->size;
+    }
+
+    if (header->size > 0 && fread(*data, header->size, 1, wal_file) != 1) return 0;
+    return wal_checksum(header, *data) == header->checksum;
+}
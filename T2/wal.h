@@ -0,0 +1,25 @@
+#ifndef WAL_H
+#define WAL_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WAL_DEFAULT_GROUP 32
+#define WAL_CHECKPOINT_BYTES (8L * 1024 * 1024)
+
+// Log de escrita antecipada (redo de imagens de página com commit em grupo)
+typedef void (*WalApplyFn)(long offset, const void* data, int size);
+
+int wal_open(const char* filename, int group_size);
+void wal_close();
+int wal_recover(WalApplyFn apply);
+long wal_append_page(long offset, const void* page, int size);
+long wal_commit(const void* header, int size);
+void wal_sync();
+void wal_force(long lsn);
+void wal_reset();
+long wal_size();
+void wal_print_stats();
+
+#endif